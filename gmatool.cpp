@@ -2,8 +2,47 @@
 #include <fstream>
 #include <string>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
 #include <algorithm>
 #include <iterator>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <mutex>
+#include <set>
+#include <filesystem>
+#include <chrono>
+#include <regex>
+#include <array>
+#include <list>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(GMATOOL_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*
 
@@ -12,6 +51,10 @@
 	1- Extract goals, switches, or other specific models from a gma / tpl file
 	2- Merge two gma / tpl files into one
 
+	It can also decode the textures of a tpl file to images for previewing,
+	write a manifest of content hashes for incremental builds, compare two
+	gma / tpl pairs, and validate gma / tpl pairs before they are processed.
+
 	gma file format:
 	https://craftedcart.github.io/SMBLevelWorkshop/documentation/index.html?page=gmaFormat
 
@@ -29,26 +72,184 @@
 #define LIST_MODELS 4
 #define LIST_AND_EXTRACT 5
 
+// One non empty model from a gma file
+struct GmaModel {
+	uint32_t headerentry; // Position in the gma header, counting empty entries
+	std::string name;
+	uint32_t start; // Absolute offset of the model header
+	uint32_t end;
+	uint16_t materialamount;
+};
+
+// One texture header entry from a tpl file
+struct TplTexture {
+	uint32_t format;
+	uint32_t offset; // 0 for empty entries
+	uint32_t length; // Up to the next texture or the end of the file, including mipmaps
+	uint16_t width;
+	uint16_t height;
+	uint16_t mipmaps;
+};
+
+// Read only stream over a file in memory, so threads can share one copy of the data with their own positions
+class MemoryStreamBuffer : public std::streambuf {
+public:
+	MemoryStreamBuffer(const std::vector<uint8_t>& data) {
+		char* begin = const_cast<char*>(reinterpret_cast<const char*>(data.data()));
+		setg(begin, begin, begin + data.size());
+	}
+
+protected:
+	pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode) override {
+		char* base = direction == std::ios_base::beg ? eback() : (direction == std::ios_base::end ? egptr() : gptr());
+		if (offset < eback() - base || offset > egptr() - base) {
+			return pos_type(off_type(-1));
+		}
+		setg(eback(), base + offset, egptr());
+		return pos_type(gptr() - eback());
+	}
+
+	pos_type seekpos(pos_type position, std::ios_base::openmode mode) override {
+		return seekoff(off_type(position), std::ios_base::beg, mode);
+	}
+};
+
+// Texture store directory and the hashes already in it, shared by extraction threads
+struct TextureStore {
+	std::string path;
+	std::mutex lock;
+	std::set<std::string> known;
+	size_t written = 0;
+	size_t referenced = 0;
+};
+
+// A gma / tpl pair loaded into memory along with its index
+struct Archive {
+	std::vector<uint8_t> gma;
+	std::vector<uint8_t> tpl;
+	std::vector<GmaModel> models;
+	std::vector<TplTexture> textures;
+};
+
+// A whole file read or write on an IoQueue
+struct IoRequest {
+	std::string path;
+	std::vector<uint8_t> data;
+	bool write = false;
+	bool done = false;
+	bool good = false;
+	int descriptor = -1;
+	size_t position = 0; // Bytes already read or written
+};
+
+// Requests are kept in a list so they don't move while the kernel has their address
+struct IoQueue {
+	std::list<IoRequest> requests;
+#if defined(__linux__) && defined(GMATOOL_IO_URING)
+	int ring = -1;
+	uint8_t* rings = nullptr;
+	size_t ringlength = 0;
+	io_uring_sqe* entries = nullptr;
+	size_t entrieslength = 0;
+	io_sqring_offsets sqoffsets;
+	io_cqring_offsets cqoffsets;
+	uint32_t depth = 0;
+	uint32_t unsubmitted = 0;
+	uint32_t inflight = 0;
+#endif
+};
+
+// The reads of a gma / tpl pair started by archiveRead
+struct ArchiveRead {
+	std::string filename;
+	IoRequest* gma;
+	IoRequest* tpl;
+};
+
 constexpr bool isLittleEndian();
-uint32_t fileIntPluck (std::ifstream& bif, uint32_t offset);
-uint16_t fileShortPluck (std::ifstream& bif, uint32_t offset);
+uint32_t fileIntPluck (std::istream& bif, uint32_t offset);
+uint16_t fileShortPluck (std::istream& bif, uint32_t offset);
 void helpText();
-void copyBytes(std::ifstream& bif, std::ofstream& bof, uint32_t offset, uint32_t length);
-void saveIntToFileEnd(std::ofstream& bof, uint32_t newint);
-void saveShortToFileEnd(std::ofstream& bof, uint16_t newint);
-uint32_t getFileLength(std::ifstream& bif);
-uint32_t getModelNameLength(std::ifstream& bif, uint32_t modelnameoffset);
-void padZeroes(std::ofstream& bof, uint32_t zeronumber);
-std::string readNameFromGma(std::ifstream& gma, uint32_t modellistpointer, uint32_t modelnamelength);
-
-size_t modelNumberWithEmpties(std::ifstream& oldgma, size_t modelnumber);
-size_t modelAmountWithoutEmpties(std::ifstream& oldgma, size_t modelamount);
-size_t indexOfFinalNonEmptyEntry(std::ifstream& oldgma, size_t modelamount);
-size_t nextNonEmptyTextureOffset(std::ifstream& oldtpl, uint32_t headerposition);
-
-void modelWriteToFiles(std::string filename, std::ifstream& oldgma, std::ifstream& oldtpl, size_t modelamount, size_t modelnumber, uint32_t modelnamelength, std::string modelname, std::string suffix);
+void copyBytes(std::istream& bif, std::ostream& bof, uint32_t offset, uint32_t length);
+void saveIntToFileEnd(std::ostream& bof, uint32_t newint);
+void saveShortToFileEnd(std::ostream& bof, uint16_t newint);
+uint32_t getFileLength(std::istream& bif);
+uint32_t getModelNameLength(std::istream& bif, uint32_t modelnameoffset);
+void padZeroes(std::ostream& bof, uint32_t zeronumber);
+std::string readNameFromGma(std::istream& gma, uint32_t modellistpointer, uint32_t modelnamelength);
+bool loadFile(std::string path, std::vector<uint8_t>& data);
+uint32_t bufferIntPluck(const std::vector<uint8_t>& buffer, uint32_t offset);
+uint16_t bufferShortPluck(const std::vector<uint8_t>& buffer, uint32_t offset);
+void parallelFor(size_t count, const std::function<void(size_t)>& work);
+uint64_t hash64(const uint8_t* data, size_t length);
+std::string jsonString(std::string text);
+
+size_t modelNumberWithEmpties(std::istream& oldgma, size_t modelnumber);
+size_t modelAmountWithoutEmpties(std::istream& oldgma, size_t modelamount);
+size_t indexOfFinalNonEmptyEntry(std::istream& oldgma, size_t modelamount);
+size_t nextNonEmptyTextureOffset(std::istream& oldtpl, uint32_t headerposition);
+
+void modelWriteToFiles(std::string filename, std::istream& oldgma, std::istream& oldtpl, size_t modelamount, size_t modelnumber, uint32_t modelnamelength, std::string modelname, std::string suffix);
+void modelWriteToStreams(std::istream& oldgma, std::istream& oldtpl, size_t modelamount, size_t modelnumber, uint32_t modelnamelength, std::string modelname, std::ostream& newgma, std::ostream& newtpl);
 int modelExtract(std::string filename, int type, std::string specificmodel);
-int gmatplMerge(std::string filename1, std::string filename2);
+int gmatplMerge(std::string filename1, std::string filename2, bool prune);
+void gmatplMergeStreams(std::istream& gma1, std::istream& tpl1, std::istream& gma2, std::istream& tpl2, std::ostream& newgma, std::ostream& newtpl);
+
+bool indexTpl(const std::vector<uint8_t>& tpl, std::vector<TplTexture>& textures);
+bool textureDecode(const std::vector<uint8_t>& tpl, const TplTexture& texture, std::vector<uint8_t>& rgba);
+bool writeImage(std::string path, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height, std::string format);
+int textureExport(std::string filename, std::string format);
+
+bool indexGma(const std::vector<uint8_t>& gma, std::vector<GmaModel>& models);
+bool loadArchive(std::string filename, Archive& archive);
+int manifestWrite(std::string filename, std::string format);
+int archiveDiff(std::string filename1, std::string filename2);
+int archiveValidate(std::vector<std::string> filenames);
+
+int streamPack(std::string filename, std::string outpath);
+int streamUnpack(std::string inpath, std::string filename);
+int streamModelExtract(std::string inpath, std::string specificmodel, std::string outpath);
+int streamMerge(std::string inpath1, std::string inpath2, std::string outpath);
+
+std::vector<std::string> modelSuffixes(const Archive& archive);
+int modelExtractAll(std::string filename, TextureStore* store);
+
+bool textureStoreOpen(std::string path, TextureStore& store);
+bool textureStorePut(TextureStore& store, const std::vector<uint8_t>& tpl, std::vector<std::string>& hashes);
+int textureStoreBuild(std::string storepath, std::string filename);
+int modelExtractAllToStore(std::string storepath, std::vector<std::string> filenames);
+
+int gmatplWatch(std::string filename1, std::string filename2, uint32_t slack);
+
+std::streambuf* keepStdoutForData(std::string outpath);
+int metadataDump(std::string filename, std::string format);
+
+void subsetWriteToStreams(const Archive& archive, const std::vector<size_t>& modelnumbers, std::ostream& newgma, std::ostream& newtpl);
+void layoutWriteToStreams(const Archive& archive, const std::vector<size_t>& modelnumbers, const std::vector<size_t>& texturenumbers, uint32_t alignment,
+	std::ostream& newgma, std::ostream& newtpl);
+void tplWriteToStream(const Archive& archive, const std::vector<size_t>& texturenumbers, uint32_t alignment, std::ostream& newtpl);
+int archiveShard(std::string filename, std::string shardlist, bool duplicatetextures);
+
+int geometryExport(std::string filename);
+
+bool ioQueueOpen(IoQueue& queue);
+IoRequest& ioRead(IoQueue& queue, std::string path);
+IoRequest& ioWrite(IoQueue& queue, std::string path, std::vector<uint8_t> data);
+void ioFlush(IoQueue& queue);
+bool ioWait(IoQueue& queue, IoRequest& request);
+void ioRelease(IoQueue& queue, IoRequest& request);
+bool ioWaitAll(IoQueue& queue);
+void ioQueueClose(IoQueue& queue);
+ArchiveRead archiveRead(IoQueue& queue, std::string filename);
+bool archiveReadFinish(IoQueue& queue, ArchiveRead& read, Archive& archive);
+
+void pruneWriteToStreams(const Archive& archive, std::ostream& newgma, std::ostream& newtpl);
+int texturePrune(std::string filename);
+
+int archiveRepack(std::string filename, std::string orderpath, std::string alignmenttext);
+
+int ruleExtract(std::string filename, std::string rulespath);
+
 /*
 
 	Main body - read in arguments
@@ -58,7 +259,7 @@ int main(int argc, char **argv) {
 	int successval = 1;
 
 	// Check Number of Arguments
-	if (argc < 3 || argc > 4) {
+	if (argc < 3) {
 		helpText();
 	} else {
 
@@ -93,12 +294,138 @@ int main(int argc, char **argv) {
 			std::string specificmodelname(argv[3]);
 			successval = modelExtract(filename, SPECIFIC_MODEL, specificmodelname);
 
+		// Extract All Models
+		} else if (operationtype == "-ae" && argc == 3) {
+
+			std::string filename(argv[2]);
+			successval = modelExtractAll(filename, nullptr);
+
+		// Extract By Name Rules
+		} else if (operationtype == "-re" && argc == 4) {
+
+			std::string filename(argv[2]);
+			std::string rulespath(argv[3]);
+			successval = ruleExtract(filename, rulespath);
+
+		// Extract All Models To A Texture Store
+		} else if (operationtype == "-aes" && argc >= 4) {
+
+			std::string storepath(argv[2]);
+			std::vector<std::string> filenames(argv + 3, argv + argc);
+			successval = modelExtractAllToStore(storepath, filenames);
+
+		// Rebuild TPL From A Texture Store
+		} else if (operationtype == "-tb" && argc == 4) {
+
+			std::string storepath(argv[2]);
+			std::string filename(argv[3]);
+			successval = textureStoreBuild(storepath, filename);
+
 		// Merge Models
-		} else if (operationtype == "-m" && argc == 4) {
+		} else if (operationtype == "-m" && (argc == 4 || (argc == 5 && std::string(argv[4]) == "prune"))) {
+
+			std::string filename1(argv[2]);
+			std::string filename2(argv[3]);
+			successval = gmatplMerge(filename1, filename2, argc == 5);
+
+		// Repack In Load Order
+		} else if (operationtype == "-rp" && (argc == 4 || argc == 5)) {
+
+			std::string filename(argv[2]);
+			std::string orderpath(argv[3]);
+			successval = archiveRepack(filename, orderpath, argc == 5 ? argv[4] : "0x20");
+
+		// Prune Unreferenced Textures
+		} else if (operationtype == "-p" && argc == 3) {
+
+			std::string filename(argv[2]);
+			successval = texturePrune(filename);
+
+		// Split Into Shards
+		} else if (operationtype == "-sh" && (argc == 4 || (argc == 5 && std::string(argv[4]) == "dup"))) {
+
+			std::string filename(argv[2]);
+			std::string shardlist(argv[3]);
+			successval = archiveShard(filename, shardlist, argc == 5);
+
+		// Merge Models And Rebuild On Changes
+		} else if (operationtype == "-w" && (argc == 4 || argc == 5)) {
+
+			std::string filename1(argv[2]);
+			std::string filename2(argv[3]);
+
+			// Decimal or 0x hex
+			unsigned long slack = 0;
+			bool slackgood = true;
+			if (argc == 5) {
+				char* slackend = nullptr;
+				errno = 0;
+				slack = strtoul(argv[4], &slackend, 0);
+				slackgood = slackend != argv[4] && *slackend == '\0' && argv[4][0] != '-' && errno != ERANGE && slack <= 0xffffffe0;
+			}
+			if (slackgood == false) {
+				std::cout << "Bad slack " << argv[4] << "! (a number of bytes, at most 0xffffffe0)" << std::endl;
+				successval = -1;
+			} else {
+				successval = gmatplWatch(filename1, filename2, slack);
+			}
+
+		// Export Geometry
+		} else if (operationtype == "-ve" && argc == 3) {
+
+			std::string filename(argv[2]);
+			successval = geometryExport(filename);
+
+		// Decode Textures
+		} else if (operationtype == "-td" && argc <= 4) {
+
+			std::string filename(argv[2]);
+			std::string format = (argc == 4) ? argv[3] : "png";
+			successval = textureExport(filename, format);
+
+		// Metadata Dump
+		} else if (operationtype == "-i" && argc <= 4) {
+
+			std::string filename(argv[2]);
+			std::string format = (argc == 4) ? argv[3] : "json";
+			successval = metadataDump(filename, format);
+
+		// Content Hash Manifest
+		} else if (operationtype == "--manifest" && argc <= 4) {
+
+			std::string filename(argv[2]);
+			std::string format = (argc == 4) ? argv[3] : "json";
+			successval = manifestWrite(filename, format);
+
+		// Compare Two Archives
+		} else if (operationtype == "-d" && argc == 4) {
 
 			std::string filename1(argv[2]);
 			std::string filename2(argv[3]);
-			successval = gmatplMerge(filename1, filename2);
+			successval = archiveDiff(filename1, filename2);
+
+		// Validate Archives
+		} else if (operationtype == "-v") {
+
+			std::vector<std::string> filenames(argv + 2, argv + argc);
+			successval = archiveValidate(filenames);
+
+		// Stream Modes
+		} else if (operationtype == "-sp" && argc == 4) {
+
+			successval = streamPack(argv[2], argv[3]);
+
+		} else if (operationtype == "-su" && argc == 4) {
+
+			successval = streamUnpack(argv[2], argv[3]);
+
+		} else if (operationtype == "-sme" && argc == 5) {
+
+			successval = streamModelExtract(argv[2], argv[3], argv[4]);
+
+		} else if (operationtype == "-sm" && argc == 5) {
+
+			successval = streamMerge(argv[2], argv[3], argv[4]);
 
 		// Invalid Arguments
 		} else {
@@ -120,18 +447,29 @@ int main(int argc, char **argv) {
 	Model Extraction
 
 */
-void modelWriteToFiles(std::string filename, std::ifstream& oldgma, std::ifstream& oldtpl, size_t modelamount, size_t modelnumber, uint32_t modelnamelength, std::string modelname, std::string suffix) {
+void modelWriteToFiles(std::string filename, std::istream& oldgma, std::istream& oldtpl, size_t modelamount, size_t modelnumber, uint32_t modelnamelength, std::string modelname, std::string suffix) {
 	/*
 	These files will create standalone TPL and GMA files, designed to be easily integrated into the main file.
 	*/
 	//First delete files
 	remove((filename + "_" + suffix + ".tpl").c_str());
 	remove((filename + "_" + suffix + ".gma").c_str());
-	//Write the GMA first, and we can get info for the TPL later
 	std::ofstream newgma(filename + "_" + suffix + ".gma", std::ios::binary | std::ios::app);
+	std::ofstream newtpl(filename + "_" + suffix + ".tpl", std::ios::binary | std::ios::app);
 
 	// Adjust model number for empty entries
 	modelnumber = modelNumberWithEmpties(oldgma, modelnumber);
+	modelWriteToStreams(oldgma, oldtpl, modelamount, modelnumber, modelnamelength, modelname, newgma, newtpl);
+
+	newgma.close();
+	newtpl.close();
+
+	std::cout << "saved to " << filename << "_" << suffix << std::endl;
+}
+
+// modelnumber is the position in the gma header, counting empty entries
+void modelWriteToStreams(std::istream& oldgma, std::istream& oldtpl, size_t modelamount, size_t modelnumber, uint32_t modelnamelength, std::string modelname, std::ostream& newgma, std::ostream& newtpl) {
+	//Write the GMA first, and we can get info for the TPL later
 
 	// Writing GMA Header
 
@@ -245,15 +583,12 @@ void modelWriteToFiles(std::string filename, std::ifstream& oldgma, std::ifstrea
 
 	// Copy the rest of the model data
 	copyBytes(oldgma, newgma, oldmodeldatastart, oldmodeldatalength);
-	newgma.close();
 
 	/* 
 
 		Done with gma, start writing tpl
 
 	*/
-	
-	std::ofstream newtpl(filename + "_" + suffix + ".tpl", std::ios::binary | std::ios::app);
 
 	// Get number of textures from earlier
 	uint32_t textureamount = texturearraypointer;
@@ -285,7 +620,8 @@ void modelWriteToFiles(std::string filename, std::ifstream& oldgma, std::ifstrea
 			// textureskips will be > 1 if there are empty textures
 			size_t textureskips = nextNonEmptyTextureOffset(oldtpl, oldtextureheaderpos);
 
-			if (texturenumber + textureskips < textureamount) {
+			// Compare against the old tpl, not the textures being copied
+			if (oldtexturevalue + textureskips < fileIntPluck(oldtpl, 0x0)) {
 				oldtextureends[texturenumber] = fileIntPluck(oldtpl, oldtextureheaderpos + (textureskips * 0x10) + 0x04);
 			} else {
 				// Account for case when all remaining textures are empty
@@ -338,9 +674,6 @@ void modelWriteToFiles(std::string filename, std::ifstream& oldgma, std::ifstrea
 	}
 
 	// Done with tpl
-	newtpl.close();
-
-	std::cout << "saved to " << filename << "_" << suffix << std::endl;
 }
 
 int modelExtract(std::string filename, int type, std::string specificmodel) {
@@ -506,31 +839,31 @@ int modelExtract(std::string filename, int type, std::string specificmodel) {
 	Model Merge
 
 */
-int gmatplMerge(std::string filename1, std::string filename2) {
-
-	// Check if the files are good
-	std::ifstream gma1;
-	std::ifstream gma2;
-	std::ifstream tpl1;
-	std::ifstream tpl2;
-	gma1.open(filename1 + ".gma", std::ios::binary);
-	if (gma1.good() == false) {
+int gmatplMerge(std::string filename1, std::string filename2, bool prune) {
+
+	// Read all four files at once, then check if they're good
+	IoQueue queue;
+	ioQueueOpen(queue);
+	ArchiveRead read1 = archiveRead(queue, filename1);
+	ArchiveRead read2 = archiveRead(queue, filename2);
+	if (ioWait(queue, *read1.gma) == false) {
 		std::cout << "First GMA not found! (" << filename1 << ".gma)" << std::endl;
+		ioQueueClose(queue);
 		return -1;
 	}
-	gma2.open(filename2 + ".gma", std::ios::binary);
-	if (gma2.good() == false) {
+	if (ioWait(queue, *read2.gma) == false) {
 		std::cout << "Second GMA not found! (" << filename2 << ".gma)" << std::endl;
+		ioQueueClose(queue);
 		return -1;
 	}
-	tpl1.open(filename1 + ".tpl", std::ios::binary);
-	if (tpl1.good() == false) {
+	if (ioWait(queue, *read1.tpl) == false) {
 		std::cout << "First TPL not found! (" << filename1 << ".tpl)" << std::endl;
+		ioQueueClose(queue);
 		return -1;
 	}
-	tpl2.open(filename2 + ".tpl", std::ios::binary);
-	if (tpl2.good() == false) {
+	if (ioWait(queue, *read2.tpl) == false) {
 		std::cout << "Second TPL not found! (" << filename2 << ".tpl)" << std::endl;
+		ioQueueClose(queue);
 		return -1;
 	}
 
@@ -543,15 +876,57 @@ int gmatplMerge(std::string filename1, std::string filename2) {
 	if (slashPos != std::string::npos) {
 		filename2 = filename2.substr(slashPos+1);
 	}
-	//Remove old files
-	remove((filename1 + "+" + filename2 + ".tpl").c_str());
-	remove((filename1 + "+" + filename2 + ".gma").c_str());
 
 	//First merge the GMA files.
 
-	//append number of models
-	std::ofstream newgma(filename1 + "+" + filename2 + ".gma", std::ios::binary | std::ios::app);
+	MemoryStreamBuffer gmabuffer1(read1.gma->data);
+	MemoryStreamBuffer tplbuffer1(read1.tpl->data);
+	MemoryStreamBuffer gmabuffer2(read2.gma->data);
+	MemoryStreamBuffer tplbuffer2(read2.tpl->data);
+	std::istream gma1(&gmabuffer1);
+	std::istream tpl1(&tplbuffer1);
+	std::istream gma2(&gmabuffer2);
+	std::istream tpl2(&tplbuffer2);
+	std::ostringstream newgma;
+	std::ostringstream newtpl;
 	std::cout << "Writing to " + filename1 + "+" + filename2 + ".gma\n";
+
+	gmatplMergeStreams(gma1, tpl1, gma2, tpl2, newgma, newtpl);
+
+	// Both outputs are written together, replacing the old files
+	std::string gmadata = newgma.str();
+	std::string tpldata = newtpl.str();
+	if (prune) {
+		Archive merged;
+		merged.gma.assign(gmadata.begin(), gmadata.end());
+		merged.tpl.assign(tpldata.begin(), tpldata.end());
+		if (indexGma(merged.gma, merged.models) == false || indexTpl(merged.tpl, merged.textures) == false) {
+			std::cout << "Merged files are corrupted, couldn't prune!" << std::endl;
+			ioQueueClose(queue);
+			return -1;
+		}
+		std::ostringstream prunedgma;
+		std::ostringstream prunedtpl;
+		pruneWriteToStreams(merged, prunedgma, prunedtpl);
+		gmadata = prunedgma.str();
+		tpldata = prunedtpl.str();
+	}
+	ioWrite(queue, filename1 + "+" + filename2 + ".gma", std::vector<uint8_t>(gmadata.begin(), gmadata.end()));
+	ioWrite(queue, filename1 + "+" + filename2 + ".tpl", std::vector<uint8_t>(tpldata.begin(), tpldata.end()));
+	ioFlush(queue);
+	bool saved = ioWaitAll(queue);
+	ioQueueClose(queue);
+
+	if (saved == false) {
+		std::cout << "Couldn't save " << filename1 << "+" << filename2 << "!" << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+void gmatplMergeStreams(std::istream& gma1, std::istream& tpl1, std::istream& gma2, std::istream& tpl2, std::ostream& newgma, std::ostream& newtpl) {
+
+	//append number of models
 	uint32_t gma1modelamount = fileIntPluck(gma1, 0x0);
 	uint32_t gma2modelamount = fileIntPluck(gma2, 0x0);
 	uint32_t newgmamodelamount = gma1modelamount + gma2modelamount;
@@ -708,11 +1083,9 @@ int gmatplMerge(std::string filename1, std::string filename2) {
 
 
 	//we're done here
-	newgma.close();
 
 
 	//Now for the TPL
-	std::ofstream newtpl(filename1 + "+" + filename2 + ".tpl", std::ios::binary | std::ios::app);
 
 
 	// Write in the new number of textures
@@ -792,154 +1165,3502 @@ int gmatplMerge(std::string filename1, std::string filename2) {
 	if (tpl2textureamount != 0) {
 		copyBytes(tpl2, newtpl, tpl2headerlength, tpl2length - tpl2headerlength);
 	}
-
-
-	// Close all files
-	newtpl.close();
-	gma1.close();
-	tpl1.close();
-	gma2.close();
-	tpl2.close();
-
-	return 0;
 }
 
 /*
 
-	Utility Functions
+	Part 3:
+	Texture Decoding
 
 */
 
-constexpr bool isLittleEndian() {
-	//shamelessly pinched from StackOverflow
-	short int number = 1;
-	char *numPtr = (char*)&number;
-	return (numPtr[0] == 1);
-	
+// GX texture formats used in tpl files
+#define GX_TF_I4 0x0
+#define GX_TF_I8 0x1
+#define GX_TF_IA4 0x2
+#define GX_TF_IA8 0x3
+#define GX_TF_RGB565 0x4
+#define GX_TF_RGB5A3 0x5
+#define GX_TF_RGBA8 0x6
+#define GX_TF_CMPR 0xE
+
+// Read every texture header entry from a tpl file held in memory
+bool indexTpl(const std::vector<uint8_t>& tpl, std::vector<TplTexture>& textures) {
+	textures.clear();
+	if (tpl.size() < 0x4) {
+		return false;
+	}
+
+	uint32_t textureamount = bufferIntPluck(tpl, 0x0);
+	if (textureamount > (tpl.size() - 0x4) / 0x10) {
+		return false;
+	}
+
+	for (uint32_t texturenumber = 0; texturenumber < textureamount; texturenumber++) {
+		uint32_t headerposition = 0x04 + 0x10 * texturenumber;
+
+		TplTexture texture;
+		texture.format = bufferIntPluck(tpl, headerposition);
+		texture.offset = bufferIntPluck(tpl, headerposition + 0x04);
+		texture.width = bufferShortPluck(tpl, headerposition + 0x08);
+		texture.height = bufferShortPluck(tpl, headerposition + 0x0A);
+		texture.mipmaps = bufferShortPluck(tpl, headerposition + 0x0C);
+		texture.length = 0;
+		textures.push_back(texture);
+	}
+
+	// Each texture ends where the next non empty one starts
+	uint32_t nextstart = tpl.size();
+	for (size_t texturenumber = textures.size(); texturenumber-- > 0;) {
+		TplTexture& texture = textures[texturenumber];
+		if (texture.offset == 0x0) {
+			continue;
+		}
+		if (texture.offset > nextstart) {
+			return false;
+		}
+		texture.length = nextstart - texture.offset;
+		nextstart = texture.offset;
+	}
+	return true;
 }
 
-uint32_t fileIntPluck (std::ifstream& bif, uint32_t offset) {
-	bif.seekg(offset, bif.beg);
-	char buffer[4]; //4 byte buffer
-	bif.read(buffer, 0x4);
-	//convert signed to unsigned
-	unsigned char* ubuf = reinterpret_cast<unsigned char*>(buffer);
-	uint32_t returnint = 0;
-	if (isLittleEndian()) {
-		returnint = (ubuf[3] << 0) | (ubuf[2] << 8) | (ubuf[1] << 16) | (ubuf[0] << 24);
-	} else {
-		returnint = (ubuf[0] << 0) | (ubuf[1] << 8) | (ubuf[2] << 16) | (ubuf[3] << 24);
+// Tile width, height and size in bytes of each format
+bool textureTileInfo(uint32_t format, uint32_t& tilewidth, uint32_t& tileheight, uint32_t& tilebytes) {
+	switch (format) {
+		case GX_TF_I4:     tilewidth = 8; tileheight = 8; tilebytes = 32; return true;
+		case GX_TF_I8:     tilewidth = 8; tileheight = 4; tilebytes = 32; return true;
+		case GX_TF_IA4:    tilewidth = 8; tileheight = 4; tilebytes = 32; return true;
+		case GX_TF_IA8:    tilewidth = 4; tileheight = 4; tilebytes = 32; return true;
+		case GX_TF_RGB565: tilewidth = 4; tileheight = 4; tilebytes = 32; return true;
+		case GX_TF_RGB5A3: tilewidth = 4; tileheight = 4; tilebytes = 32; return true;
+		case GX_TF_RGBA8:  tilewidth = 4; tileheight = 4; tilebytes = 64; return true;
+		case GX_TF_CMPR:   tilewidth = 8; tileheight = 8; tilebytes = 32; return true;
+		default: return false;
 	}
-	return returnint;
 }
 
-uint16_t fileShortPluck (std::ifstream& bif, uint32_t offset) {
-	bif.seekg(offset, bif.beg);
-	char buffer[2]; //2 byte buffer
-	bif.read(buffer, 0x2);
-	//convert signed to unsigned
-	unsigned char* ubuf = reinterpret_cast<unsigned char*>(buffer);
-	uint16_t returnshort = 0;
-	if (isLittleEndian()) {
-		returnshort = (ubuf[1] << 0) | (ubuf[0] << 8);
-	} else {
-		returnshort = (ubuf[0] << 0) | (ubuf[1] << 8);
+// Expand separate intensity and alpha values into RGBA pixels, count must be a multiple of 16
+void storeIntensityAlpha(const uint8_t* intensity, const uint8_t* alpha, size_t count, uint8_t* rgba) {
+#if defined(__SSE2__)
+	for (size_t pixel = 0; pixel < count; pixel += 16) {
+		__m128i i = _mm_loadu_si128(reinterpret_cast<const __m128i*>(intensity + pixel));
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + pixel));
+		__m128i iilo = _mm_unpacklo_epi8(i, i);
+		__m128i iihi = _mm_unpackhi_epi8(i, i);
+		__m128i ialo = _mm_unpacklo_epi8(i, a);
+		__m128i iahi = _mm_unpackhi_epi8(i, a);
+		__m128i* out = reinterpret_cast<__m128i*>(rgba + pixel * 4);
+		_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(iilo, ialo));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(iilo, ialo));
+		_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(iihi, iahi));
+		_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(iihi, iahi));
 	}
-	return returnshort;
+#else
+	for (size_t pixel = 0; pixel < count; pixel++) {
+		rgba[pixel * 4 + 0] = intensity[pixel];
+		rgba[pixel * 4 + 1] = intensity[pixel];
+		rgba[pixel * 4 + 2] = intensity[pixel];
+		rgba[pixel * 4 + 3] = alpha[pixel];
+	}
+#endif
 }
 
-void helpText() {
-	std::cout << "How to use gmatool:\n" 
-		<< "Each of these saves extracted data to unique and readable gma and tpl files, and do not alter the input files.\n"
-		<< "\"-ge <name>\" - Extracts goal data from <name>.gma and <name>.tpl.\n"
-		<< "\"-se <name>\" - Extracts switch data from <name>.gma and <name>.tpl, saving each switch to unique files, including switch bases.\n"
-		<< "\"-me <name> <modelname>\" - Extracts the data of the model called \"modelname\" from <name>.gma and <name>.tpl.\n"
-		<< "\"-l <name>\" - Lists all models in <name>.gma.\n"
-		<< "\"-le <name>\" - Combines the functionality of \"-l\" and \"-me\".\n"
-		<< "\"-m <name1> <name2>\" - Extracts all data from <name1>.gma, <name2>.gma, <name1>.tpl and <name2>.tpl, and combines the data. "
-		<< "The second file's data is always placed after the first." << std::endl;
+// RGBA8 tiles hold 16 AR pairs followed by 16 GB pairs
+void storeSplitRgba8(const uint8_t* src, uint8_t* rgba) {
+#if defined(__SSE2__)
+	for (size_t half = 0; half < 2; half++) {
+		__m128i ar = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + half * 16));
+		__m128i gb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32 + half * 16));
+
+		// Interleaving gives ARGB, rotating each pixel by a byte gives RGBA
+		__m128i argblo = _mm_unpacklo_epi16(ar, gb);
+		__m128i argbhi = _mm_unpackhi_epi16(ar, gb);
+		__m128i* out = reinterpret_cast<__m128i*>(rgba + half * 32);
+		_mm_storeu_si128(out + 0, _mm_or_si128(_mm_srli_epi32(argblo, 8), _mm_slli_epi32(argblo, 24)));
+		_mm_storeu_si128(out + 1, _mm_or_si128(_mm_srli_epi32(argbhi, 8), _mm_slli_epi32(argbhi, 24)));
+	}
+#else
+	for (size_t pixel = 0; pixel < 16; pixel++) {
+		rgba[pixel * 4 + 0] = src[pixel * 2 + 1];
+		rgba[pixel * 4 + 1] = src[32 + pixel * 2];
+		rgba[pixel * 4 + 2] = src[32 + pixel * 2 + 1];
+		rgba[pixel * 4 + 3] = src[pixel * 2];
+	}
+#endif
 }
 
-void copyBytes(std::ifstream& bif, std::ofstream& bof, uint32_t offset, uint32_t length) {
-	char bytes[length];
-	bif.seekg(offset, bif.beg);
-	bif.read(bytes, length);
-	bof.write(bytes, length);
+void storeRgb565(uint16_t colour, uint8_t* rgba) {
+	rgba[0] = ((colour >> 11) & 0x1f) * 0xff / 0x1f;
+	rgba[1] = ((colour >> 5) & 0x3f) * 0xff / 0x3f;
+	rgba[2] = (colour & 0x1f) * 0xff / 0x1f;
+	rgba[3] = 0xff;
 }
 
-void saveIntToFileEnd(std::ofstream& bof, uint32_t newint) {
-	char buffer[4];
-	char* initbuffer = reinterpret_cast<char*>(&newint);
-		//assigns values wrt endianness
-		if (isLittleEndian()) {
-			for (int i = 0; i < 4; i++) {
-				buffer[i] = initbuffer[3-i];
+void storeRgb5a3(uint16_t colour, uint8_t* rgba) {
+	if (colour & 0x8000) {
+		// RGB555, opaque
+		rgba[0] = ((colour >> 10) & 0x1f) * 0xff / 0x1f;
+		rgba[1] = ((colour >> 5) & 0x1f) * 0xff / 0x1f;
+		rgba[2] = (colour & 0x1f) * 0xff / 0x1f;
+		rgba[3] = 0xff;
+	} else {
+		// RGB4A3
+		rgba[0] = ((colour >> 8) & 0xf) * 0x11;
+		rgba[1] = ((colour >> 4) & 0xf) * 0x11;
+		rgba[2] = (colour & 0xf) * 0x11;
+		rgba[3] = ((colour >> 12) & 0x7) * 0xff / 0x7;
+	}
+}
+
+// CMPR tiles are four DXT1 blocks in the order top left, top right, bottom left, bottom right
+void decodeCmprTile(const uint8_t* src, uint8_t* tile) {
+	for (size_t block = 0; block < 4; block++) {
+		const uint8_t* blocksrc = src + block * 8;
+		uint16_t colour0 = (blocksrc[0] << 8) | blocksrc[1];
+		uint16_t colour1 = (blocksrc[2] << 8) | blocksrc[3];
+
+		uint8_t palette[4][4];
+		storeRgb565(colour0, palette[0]);
+		storeRgb565(colour1, palette[1]);
+		for (size_t channel = 0; channel < 3; channel++) {
+			if (colour0 > colour1) {
+				palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+				palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+			} else {
+				palette[2][channel] = (palette[0][channel] + palette[1][channel]) / 2;
+				palette[3][channel] = 0;
 			}
-		} else {
-			for (int i = 0; i < 4; i++) {
-				buffer[i] = initbuffer[i];
+		}
+		palette[2][3] = 0xff;
+		palette[3][3] = (colour0 > colour1) ? 0xff : 0x00;
+
+		// Two bits per pixel, most significant first
+		size_t blockx = (block & 1) * 4;
+		size_t blocky = (block >> 1) * 4;
+		for (size_t row = 0; row < 4; row++) {
+			uint8_t indices = blocksrc[4 + row];
+			for (size_t column = 0; column < 4; column++) {
+				uint8_t paletteindex = (indices >> (6 - column * 2)) & 0x3;
+				memcpy(tile + ((blocky + row) * 8 + blockx + column) * 4, palette[paletteindex], 4);
 			}
 		}
-		//write float
-		bof.write(buffer, sizeof(uint32_t));
+	}
 }
 
-void saveShortToFileEnd(std::ofstream& bof, uint16_t newint) {
-	char buffer[2];
-	char* initbuffer = reinterpret_cast<char*>(&newint);
-		//assigns values wrt endianness
-		if (isLittleEndian()) {
-			for (int i = 0; i < 2; i++) {
-				buffer[i] = initbuffer[1-i];
+// Decode one tile into tilewidth * tileheight RGBA pixels
+void decodeTile(uint32_t format, const uint8_t* src, uint8_t* tile) {
+	uint8_t intensity[64];
+	uint8_t alpha[64];
+
+	switch (format) {
+		case GX_TF_I4:
+			for (size_t i = 0; i < 32; i++) {
+				intensity[i * 2] = (src[i] >> 4) * 0x11;
+				intensity[i * 2 + 1] = (src[i] & 0xf) * 0x11;
 			}
-		} else {
-			for (int i = 0; i < 2; i++) {
-				buffer[i] = initbuffer[i];
+			memset(alpha, 0xff, 64);
+			storeIntensityAlpha(intensity, alpha, 64, tile);
+			break;
+		case GX_TF_I8:
+			memset(alpha, 0xff, 32);
+			storeIntensityAlpha(src, alpha, 32, tile);
+			break;
+		case GX_TF_IA4:
+			for (size_t i = 0; i < 32; i++) {
+				alpha[i] = (src[i] >> 4) * 0x11;
+				intensity[i] = (src[i] & 0xf) * 0x11;
+			}
+			storeIntensityAlpha(intensity, alpha, 32, tile);
+			break;
+		case GX_TF_IA8:
+			for (size_t i = 0; i < 16; i++) {
+				alpha[i] = src[i * 2];
+				intensity[i] = src[i * 2 + 1];
+			}
+			storeIntensityAlpha(intensity, alpha, 16, tile);
+			break;
+		case GX_TF_RGB565:
+			for (size_t i = 0; i < 16; i++) {
+				storeRgb565((src[i * 2] << 8) | src[i * 2 + 1], tile + i * 4);
+			}
+			break;
+		case GX_TF_RGB5A3:
+			for (size_t i = 0; i < 16; i++) {
+				storeRgb5a3((src[i * 2] << 8) | src[i * 2 + 1], tile + i * 4);
+			}
+			break;
+		case GX_TF_RGBA8:
+			storeSplitRgba8(src, tile);
+			break;
+		case GX_TF_CMPR:
+			decodeCmprTile(src, tile);
+			break;
+	}
+}
+
+// Decode the first mipmap of a texture into linear RGBA8
+bool textureDecode(const std::vector<uint8_t>& tpl, const TplTexture& texture, std::vector<uint8_t>& rgba) {
+	uint32_t tilewidth, tileheight, tilebytes;
+	if (texture.offset == 0x0 || textureTileInfo(texture.format, tilewidth, tileheight, tilebytes) == false) {
+		return false;
+	}
+
+	uint32_t tilesacross = (texture.width + tilewidth - 1) / tilewidth;
+	uint32_t tilesdown = (texture.height + tileheight - 1) / tileheight;
+	uint64_t texturebytes = uint64_t(tilesacross) * tilesdown * tilebytes;
+	if (texturebytes > texture.length) {
+		return false;
+	}
+
+	rgba.assign(size_t(texture.width) * texture.height * 4, 0);
+	const uint8_t* src = tpl.data() + texture.offset;
+	uint8_t tile[8 * 8 * 4];
+
+	for (uint32_t tiley = 0; tiley < tilesdown; tiley++) {
+		for (uint32_t tilex = 0; tilex < tilesacross; tilex++) {
+			decodeTile(texture.format, src, tile);
+			src += tilebytes;
+
+			// Copy tile rows into the image, clipping tiles that hang over the edge
+			uint32_t startx = tilex * tilewidth;
+			uint32_t rowpixels = std::min(tilewidth, uint32_t(texture.width - startx));
+			for (uint32_t row = 0; row < tileheight; row++) {
+				uint32_t y = tiley * tileheight + row;
+				if (y >= texture.height) {
+					break;
+				}
+				memcpy(&rgba[(size_t(y) * texture.width + startx) * 4], tile + row * tilewidth * 4, rowpixels * 4);
 			}
 		}
-		//write float
-		bof.write(buffer, sizeof(uint16_t));
+	}
+	return true;
 }
 
-uint32_t getFileLength(std::ifstream& bif) {
-	bif.seekg(0, bif.end);
-	return bif.tellg();
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc) {
+	static const std::vector<uint32_t> table = [] {
+		std::vector<uint32_t> entries(256);
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+			}
+			entries[n] = c;
+		}
+		return entries;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
 }
 
-// Length of a model name from a gma header, Includes the terminating byte.
-uint32_t getModelNameLength(std::ifstream& bif, uint32_t modelnameoffset) {
+void appendInt(std::vector<uint8_t>& buffer, uint32_t value) {
+	buffer.push_back(value >> 24);
+	buffer.push_back(value >> 16);
+	buffer.push_back(value >> 8);
+	buffer.push_back(value);
+}
 
-	// Get to start of model name
-	bif.seekg(modelnameoffset, bif.beg);
+void writePngChunk(std::ostream& bof, const char* type, const std::vector<uint8_t>& data) {
+	std::vector<uint8_t> chunk(type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	saveIntToFileEnd(bof, data.size());
+	bof.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+	saveIntToFileEnd(bof, crc32(chunk.data(), chunk.size(), 0));
+}
 
-	size_t modelnamelength = 0;
-	bool endofmodelname = false;
-	char endingbyte;
+// Writes decoded pixels as png (stored deflate, so no zlib needed), ppm (alpha dropped) or raw RGBA8
+bool writeImage(std::string path, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height, std::string format) {
+	std::ofstream image(path, std::ios::binary | std::ios::trunc);
+	if (image.good() == false) {
+		return false;
+	}
 
-	// Read name byte by byte
-	while (endofmodelname == false) {
-		modelnamelength++;
-		bif.read(&endingbyte, 1);
-		if (bif.eof() || endingbyte == '\0') {
-			endofmodelname = true;
+	if (format == "raw") {
+		image.write(reinterpret_cast<const char*>(rgba.data()), rgba.size());
+
+	} else if (format == "ppm") {
+		image << "P6\n" << width << " " << height << "\n255\n";
+		std::vector<uint8_t> rgb(size_t(width) * height * 3);
+		for (size_t pixel = 0; pixel < size_t(width) * height; pixel++) {
+			memcpy(&rgb[pixel * 3], &rgba[pixel * 4], 3);
 		}
+		image.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+
+	} else {
+		const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+		image.write(reinterpret_cast<const char*>(signature), 8);
+
+		std::vector<uint8_t> header;
+		appendInt(header, width);
+		appendInt(header, height);
+		header.push_back(8); // bit depth
+		header.push_back(6); // RGBA
+		header.push_back(0);
+		header.push_back(0);
+		header.push_back(0);
+		writePngChunk(image, "IHDR", header);
+
+		// Every row starts with filter type 0
+		size_t rowbytes = size_t(width) * 4;
+		std::vector<uint8_t> scanlines;
+		scanlines.reserve((rowbytes + 1) * height);
+		for (uint32_t y = 0; y < height; y++) {
+			scanlines.push_back(0);
+			scanlines.insert(scanlines.end(), rgba.begin() + y * rowbytes, rgba.begin() + (y + 1) * rowbytes);
+		}
+
+		// zlib stream made of stored blocks of at most 0xffff bytes
+		std::vector<uint8_t> compressed = {0x78, 0x01};
+		size_t position = 0;
+		do {
+			size_t blocklength = std::min(scanlines.size() - position, size_t(0xffff));
+			compressed.push_back(position + blocklength == scanlines.size() ? 1 : 0);
+			compressed.push_back(blocklength & 0xff);
+			compressed.push_back(blocklength >> 8);
+			compressed.push_back(~blocklength & 0xff);
+			compressed.push_back((~blocklength >> 8) & 0xff);
+			compressed.insert(compressed.end(), scanlines.begin() + position, scanlines.begin() + position + blocklength);
+			position += blocklength;
+		} while (position < scanlines.size());
+
+		uint32_t adlera = 1;
+		uint32_t adlerb = 0;
+		for (uint8_t byte : scanlines) {
+			adlera = (adlera + byte) % 65521;
+			adlerb = (adlerb + adlera) % 65521;
+		}
+		appendInt(compressed, (adlerb << 16) | adlera);
+		writePngChunk(image, "IDAT", compressed);
+		writePngChunk(image, "IEND", std::vector<uint8_t>());
 	}
-	
-	return modelnamelength;
+
+	image.close();
+	return image.good();
 }
 
-void padZeroes(std::ofstream& bof, uint32_t zeronumber) {
-	char buffer[zeronumber];
-	memset(buffer, 0x0, zeronumber);
-	bof.write(buffer, zeronumber);
+int textureExport(std::string filename, std::string format) {
+
+	if (format != "png" && format != "ppm" && format != "raw") {
+		std::cout << "Unknown image format " << format << "! (png, ppm or raw)" << std::endl;
+		return -1;
+	}
+
+	std::vector<uint8_t> tpl;
+	if (loadFile(filename + ".tpl", tpl) == false) {
+		std::cout << "No TPL found!" << std::endl;
+		return -1;
+	}
+
+	std::vector<TplTexture> textures;
+	if (indexTpl(tpl, textures) == false) {
+		std::cout << "TPL header is corrupted! (" << filename << ".tpl)" << std::endl;
+		return -1;
+	}
+
+	// Decode and save each texture on its own thread
+	std::vector<uint8_t> decoded(textures.size(), 0);
+	parallelFor(textures.size(), [&](size_t texturenumber) {
+		const TplTexture& texture = textures[texturenumber];
+		std::vector<uint8_t> rgba;
+		if (textureDecode(tpl, texture, rgba)) {
+			std::string path = filename + "_texture" + std::to_string(texturenumber) + "." + format;
+			decoded[texturenumber] = writeImage(path, rgba, texture.width, texture.height, format);
+		}
+	});
+
+	size_t decodedamount = 0;
+	for (size_t texturenumber = 0; texturenumber < textures.size(); texturenumber++) {
+		if (decoded[texturenumber]) {
+			decodedamount++;
+		} else if (textures[texturenumber].offset != 0x0) {
+			std::cout << "Skipped texture " << texturenumber << " (format 0x" << std::hex << textures[texturenumber].format << std::dec << ")" << std::endl;
+		}
+	}
+	std::cout << "Decoded " << decodedamount << " textures to " << filename << "_texture*." << format << std::endl;
+
+	return 0;
 }
 
-std::string readNameFromGma(std::ifstream& gma, uint32_t modellistpointer, uint32_t modelnamelength) {
-	char bytes[modelnamelength];
-	gma.seekg(modellistpointer, gma.beg);
-	gma.read(bytes, modelnamelength);
-	std::string modelname(bytes);
-	return modelname;
+/*
+
+	Part 4:
+	Content Hash Manifest
+
+*/
+
+// Read every non empty model from a gma file held in memory, checking that entries stay inside the file
+bool indexGma(const std::vector<uint8_t>& gma, std::vector<GmaModel>& models) {
+	models.clear();
+	if (gma.size() < 0x8) {
+		return false;
+	}
+
+	uint32_t modelamount = bufferIntPluck(gma, 0x0);
+	uint32_t headerlength = bufferIntPluck(gma, 0x4);
+	if (headerlength < 0x8 || headerlength > gma.size() || modelamount > (headerlength - 0x8) / 0x8) {
+		return false;
+	}
+	uint32_t nameliststart = 0x8 + 0x8 * modelamount;
+
+	for (uint32_t headerentry = 0; headerentry < modelamount; headerentry++) {
+		uint32_t dataoffset = bufferIntPluck(gma, 0x8 + 0x8 * headerentry);
+		if (dataoffset == 0xffffffff) {
+			continue;
+		}
+
+		GmaModel model;
+		model.headerentry = headerentry;
+		model.start = headerlength + dataoffset;
+		model.end = gma.size();
+
+		// Name has to be terminated before the end of the header
+		uint32_t namestart = nameliststart + bufferIntPluck(gma, 0xC + 0x8 * headerentry);
+		uint32_t nameend = namestart;
+		while (nameend < headerlength && gma[nameend] != '\0') {
+			nameend++;
+		}
+		if (dataoffset > gma.size() - headerlength || nameend >= headerlength) {
+			return false;
+		}
+		model.name.assign(reinterpret_cast<const char*>(&gma[namestart]), nameend - namestart);
+		models.push_back(model);
+	}
+
+	// Each model ends where the next non empty one starts
+	for (size_t modelnumber = 0; modelnumber + 1 < models.size(); modelnumber++) {
+		models[modelnumber].end = models[modelnumber + 1].start;
+	}
+
+	for (GmaModel& model : models) {
+		if (model.end < model.start || model.end - model.start < 0x40) {
+			return false;
+		}
+		model.materialamount = bufferShortPluck(gma, model.start + 0x18);
+		if (0x40 + 0x20 * uint32_t(model.materialamount) > model.end - model.start) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Load and index a gma / tpl pair, reporting any problem
+bool loadArchive(std::string filename, Archive& archive) {
+	IoQueue queue;
+	ioQueueOpen(queue);
+	ArchiveRead read = archiveRead(queue, filename);
+	bool loaded = archiveReadFinish(queue, read, archive);
+	ioQueueClose(queue);
+	return loaded;
+}
+
+std::string hashString(uint64_t hash) {
+	char text[17];
+	snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+	return text;
+}
+
+int manifestWrite(std::string filename, std::string format) {
+
+	if (format != "json" && format != "bin") {
+		std::cout << "Unknown manifest format " << format << "! (json or bin)" << std::endl;
+		return -1;
+	}
+
+	Archive archive;
+	if (loadArchive(filename, archive) == false) {
+		return -1;
+	}
+	const std::vector<uint8_t>& gma = archive.gma;
+	const std::vector<uint8_t>& tpl = archive.tpl;
+	const std::vector<GmaModel>& models = archive.models;
+	const std::vector<TplTexture>& textures = archive.textures;
+
+	// Hash whole models, their material blocks and textures in parallel
+	std::vector<uint64_t> modelhashes(models.size());
+	std::vector<uint64_t> materialhashes(models.size());
+	std::vector<uint64_t> texturehashes(textures.size());
+	parallelFor(models.size() + textures.size(), [&](size_t index) {
+		if (index < models.size()) {
+			const GmaModel& model = models[index];
+			modelhashes[index] = hash64(&gma[model.start], model.end - model.start);
+			materialhashes[index] = hash64(&gma[model.start + 0x40], 0x20 * model.materialamount);
+		} else {
+			const TplTexture& texture = textures[index - models.size()];
+			texturehashes[index - models.size()] = hash64(tpl.data() + texture.offset, texture.length);
+		}
+	});
+
+	std::string manifestname = filename + "_manifest." + format;
+	std::ofstream manifest(manifestname, std::ios::binary | std::ios::trunc);
+
+	if (format == "json") {
+		manifest << "{\n\t\"gma\": " << jsonString(filename + ".gma") << ",\n\t\"tpl\": " << jsonString(filename + ".tpl") << ",\n\t\"models\": [";
+		for (size_t modelnumber = 0; modelnumber < models.size(); modelnumber++) {
+			const GmaModel& model = models[modelnumber];
+			manifest << (modelnumber == 0 ? "\n" : ",\n")
+				<< "\t\t{\"name\": " << jsonString(model.name)
+				<< ", \"entry\": " << model.headerentry
+				<< ", \"offset\": " << model.start
+				<< ", \"size\": " << model.end - model.start
+				<< ", \"hash\": \"" << hashString(modelhashes[modelnumber]) << "\""
+				<< ", \"materials\": {\"offset\": " << model.start + 0x40
+				<< ", \"size\": " << 0x20 * model.materialamount
+				<< ", \"hash\": \"" << hashString(materialhashes[modelnumber]) << "\"}}";
+		}
+		manifest << "\n\t],\n\t\"textures\": [";
+		bool firsttexture = true;
+		for (size_t texturenumber = 0; texturenumber < textures.size(); texturenumber++) {
+			const TplTexture& texture = textures[texturenumber];
+			if (texture.offset == 0x0) {
+				continue;
+			}
+			manifest << (firsttexture ? "\n" : ",\n")
+				<< "\t\t{\"index\": " << texturenumber
+				<< ", \"format\": " << texture.format
+				<< ", \"offset\": " << texture.offset
+				<< ", \"size\": " << texture.length
+				<< ", \"hash\": \"" << hashString(texturehashes[texturenumber]) << "\"}";
+			firsttexture = false;
+		}
+		manifest << "\n\t]\n}\n";
+
+	} else {
+		// Big endian, like the gma and tpl files themselves
+		manifest << "GMAN";
+		saveIntToFileEnd(manifest, 1); // version
+		saveIntToFileEnd(manifest, models.size());
+		saveIntToFileEnd(manifest, textures.size());
+		for (size_t modelnumber = 0; modelnumber < models.size(); modelnumber++) {
+			const GmaModel& model = models[modelnumber];
+			saveIntToFileEnd(manifest, model.headerentry);
+			saveIntToFileEnd(manifest, model.start);
+			saveIntToFileEnd(manifest, model.end - model.start);
+			saveIntToFileEnd(manifest, modelhashes[modelnumber] >> 32);
+			saveIntToFileEnd(manifest, modelhashes[modelnumber]);
+			saveIntToFileEnd(manifest, model.start + 0x40);
+			saveIntToFileEnd(manifest, 0x20 * model.materialamount);
+			saveIntToFileEnd(manifest, materialhashes[modelnumber] >> 32);
+			saveIntToFileEnd(manifest, materialhashes[modelnumber]);
+			saveShortToFileEnd(manifest, model.name.size());
+			manifest << model.name;
+		}
+		// Empty entries are kept (with zero offset and size) so indices line up with the tpl
+		for (size_t texturenumber = 0; texturenumber < textures.size(); texturenumber++) {
+			const TplTexture& texture = textures[texturenumber];
+			saveIntToFileEnd(manifest, texture.format);
+			saveIntToFileEnd(manifest, texture.offset);
+			saveIntToFileEnd(manifest, texture.length);
+			saveIntToFileEnd(manifest, texturehashes[texturenumber] >> 32);
+			saveIntToFileEnd(manifest, texturehashes[texturenumber]);
+		}
+	}
+
+	manifest.close();
+	std::cout << "Manifest of " << models.size() << " models and " << textures.size() << " textures saved to " << manifestname << std::endl;
+	return 0;
+}
+
+/*
+
+	Part 5:
+	Archive Diff
+
+*/
+
+// Hashes of the sections of a model that can differ between archives
+struct ModelHashes {
+	uint64_t header;
+	uint64_t materials;
+	uint64_t data; // Vertex and display list data after the material entries
+};
+
+// Material texture indices are replaced by the hash of the texture they point to, so a model still matches when its textures move
+ModelHashes hashModelSections(const Archive& archive, const std::vector<uint64_t>& texturehashes, const GmaModel& model) {
+	ModelHashes hashes;
+	uint32_t datastart = model.start + 0x40 + 0x20 * model.materialamount;
+	hashes.header = hash64(&archive.gma[model.start], 0x40);
+	hashes.data = hash64(archive.gma.data() + datastart, model.end - datastart);
+
+	std::vector<uint8_t> materials(archive.gma.begin() + model.start + 0x40, archive.gma.begin() + datastart);
+	for (uint32_t materialnumber = 0; materialnumber < model.materialamount; materialnumber++) {
+		uint16_t textureindex = bufferShortPluck(materials, 0x20 * materialnumber + 0x04);
+		uint64_t texturehash = textureindex < texturehashes.size() ? texturehashes[textureindex] : textureindex;
+		materials[0x20 * materialnumber + 0x04] = 0;
+		materials[0x20 * materialnumber + 0x05] = 0;
+		for (int shift = 0; shift < 64; shift += 8) {
+			materials.push_back(texturehash >> shift);
+		}
+	}
+	hashes.materials = hash64(materials.data(), materials.size());
+	return hashes;
+}
+
+// Hash every texture then every model section of an archive in parallel
+void hashArchive(const Archive& archive, std::vector<uint64_t>& texturehashes, std::vector<ModelHashes>& modelhashes) {
+	texturehashes.assign(archive.textures.size(), 0);
+	modelhashes.assign(archive.models.size(), ModelHashes());
+	parallelFor(archive.textures.size(), [&](size_t texturenumber) {
+		const TplTexture& texture = archive.textures[texturenumber];
+		texturehashes[texturenumber] = hash64(archive.tpl.data() + texture.offset, texture.length);
+	});
+	parallelFor(archive.models.size(), [&](size_t modelnumber) {
+		modelhashes[modelnumber] = hashModelSections(archive, texturehashes, archive.models[modelnumber]);
+	});
+}
+
+// Textures of the first list whose content doesn't appear in the second
+std::vector<size_t> unmatchedTextures(const Archive& archive1, const std::vector<uint64_t>& texturehashes1, const Archive& archive2, const std::vector<uint64_t>& texturehashes2) {
+	std::map<uint64_t, size_t> available;
+	for (size_t texturenumber = 0; texturenumber < texturehashes2.size(); texturenumber++) {
+		if (archive2.textures[texturenumber].offset != 0x0) {
+			available[texturehashes2[texturenumber]]++;
+		}
+	}
+
+	std::vector<size_t> unmatched;
+	for (size_t texturenumber = 0; texturenumber < texturehashes1.size(); texturenumber++) {
+		if (archive1.textures[texturenumber].offset == 0x0) {
+			continue;
+		}
+		auto match = available.find(texturehashes1[texturenumber]);
+		if (match == available.end() || match->second == 0) {
+			unmatched.push_back(texturenumber);
+		} else {
+			match->second--;
+		}
+	}
+	return unmatched;
+}
+
+int archiveDiff(std::string filename1, std::string filename2) {
+
+	Archive archive1;
+	Archive archive2;
+	if (loadArchive(filename1, archive1) == false || loadArchive(filename2, archive2) == false) {
+		return -1;
+	}
+
+	std::vector<uint64_t> texturehashes1;
+	std::vector<uint64_t> texturehashes2;
+	std::vector<ModelHashes> modelhashes1;
+	std::vector<ModelHashes> modelhashes2;
+	hashArchive(archive1, texturehashes1, modelhashes1);
+	hashArchive(archive2, texturehashes2, modelhashes2);
+
+	// Pair models by name, in order of appearance when a name is used more than once
+	std::map<std::string, std::vector<size_t>> models2byname;
+	for (size_t modelnumber = archive2.models.size(); modelnumber-- > 0;) {
+		models2byname[archive2.models[modelnumber].name].push_back(modelnumber);
+	}
+
+	size_t differences = 0;
+	size_t unchanged = 0;
+	for (size_t modelnumber1 = 0; modelnumber1 < archive1.models.size(); modelnumber1++) {
+		const GmaModel& model = archive1.models[modelnumber1];
+		std::vector<size_t>& candidates = models2byname[model.name];
+
+		if (candidates.empty()) {
+			std::cout << "Removed: " << model.name << std::endl;
+			differences++;
+			continue;
+		}
+		size_t modelnumber2 = candidates.back();
+		candidates.pop_back();
+
+		const ModelHashes& hashes1 = modelhashes1[modelnumber1];
+		const ModelHashes& hashes2 = modelhashes2[modelnumber2];
+		std::string sections;
+		if (hashes1.header != hashes2.header) {
+			sections += ", header";
+		}
+		if (hashes1.materials != hashes2.materials) {
+			sections += ", materials";
+		}
+		if (hashes1.data != hashes2.data) {
+			sections += ", vertex / display list data";
+		}
+
+		if (sections.empty()) {
+			unchanged++;
+		} else {
+			std::cout << "Changed: " << model.name << " (" << sections.substr(2) << ")" << std::endl;
+			differences++;
+		}
+	}
+
+	// Whatever is left over only exists in the second archive
+	for (size_t modelnumber2 = 0; modelnumber2 < archive2.models.size(); modelnumber2++) {
+		std::vector<size_t>& candidates = models2byname[archive2.models[modelnumber2].name];
+		if (std::find(candidates.begin(), candidates.end(), modelnumber2) != candidates.end()) {
+			std::cout << "Added: " << archive2.models[modelnumber2].name << std::endl;
+			differences++;
+		}
+	}
+
+	std::vector<size_t> removedtextures = unmatchedTextures(archive1, texturehashes1, archive2, texturehashes2);
+	std::vector<size_t> addedtextures = unmatchedTextures(archive2, texturehashes2, archive1, texturehashes1);
+	for (size_t texturenumber : removedtextures) {
+		std::cout << "Removed texture: " << filename1 << ".tpl #" << texturenumber << std::endl;
+	}
+	for (size_t texturenumber : addedtextures) {
+		std::cout << "Added texture: " << filename2 << ".tpl #" << texturenumber << std::endl;
+	}
+	differences += removedtextures.size() + addedtextures.size();
+
+	std::cout << unchanged << " models unchanged, " << differences << " differences" << std::endl;
+
+	// Like diff, differences aren't an error but are reported through the return value
+	return differences == 0 ? 0 : 1;
+}
+
+/*
+
+	Part 6:
+	Archive Validation
+
+*/
+
+std::string hexString(uint32_t value) {
+	char text[11];
+	snprintf(text, sizeof(text), "0x%x", value);
+	return text;
+}
+
+// Size of a texture including its mipmaps, 0 for formats without a known tile layout
+uint64_t textureDataLength(uint32_t format, uint32_t width, uint32_t height, uint32_t mipmaps) {
+	uint32_t tilewidth, tileheight, tilebytes;
+	if (textureTileInfo(format, tilewidth, tileheight, tilebytes) == false) {
+		return 0;
+	}
+	uint64_t length = 0;
+	for (uint32_t level = 0; level < std::max(mipmaps, 1u); level++) {
+		length += uint64_t((width + tilewidth - 1) / tilewidth) * ((height + tileheight - 1) / tileheight) * tilebytes;
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+	return length;
+}
+
+// Check every header entry, name, material and texture range of a gma / tpl pair against the file bounds
+// Problems are printed, and the number found is returned
+size_t validateArchive(IoQueue& queue, ArchiveRead& read, size_t& modelamountchecked, size_t& textureamountchecked) {
+	std::string filename = read.filename;
+	std::vector<std::string> problems;
+
+	if (ioWait(queue, *read.gma) == false) {
+		problems.push_back("GMA not found");
+	}
+	if (ioWait(queue, *read.tpl) == false) {
+		problems.push_back("TPL not found");
+	}
+	std::vector<uint8_t> gma = std::move(read.gma->data);
+	std::vector<uint8_t> tpl = std::move(read.tpl->data);
+	ioRelease(queue, *read.gma);
+	ioRelease(queue, *read.tpl);
+	if (problems.empty() == false) {
+		for (std::string& problem : problems) {
+			std::cout << filename << ": " << problem << std::endl;
+		}
+		return problems.size();
+	}
+
+	// TPL header entries and texture ranges
+	uint32_t textureamount = 0;
+	std::vector<bool> textureusable;
+	if (tpl.size() < 0x4) {
+		problems.push_back("tpl: file is too short for a header");
+	} else {
+		textureamount = bufferIntPluck(tpl, 0x0);
+		if (textureamount > (tpl.size() - 0x4) / 0x10) {
+			problems.push_back("tpl: " + std::to_string(textureamount) + " texture entries run past the end of the file");
+			textureamount = (tpl.size() - 0x4) / 0x10;
+		}
+	}
+	textureamountchecked += textureamount;
+	textureusable.assign(textureamount, false);
+
+	uint32_t tplheaderend = 0x4 + 0x10 * textureamount;
+	uint32_t previousstart = 0;
+	for (uint32_t texturenumber = 0; texturenumber < textureamount; texturenumber++) {
+		uint32_t headerposition = 0x4 + 0x10 * texturenumber;
+		uint32_t offset = bufferIntPluck(tpl, headerposition + 0x04);
+		if (offset == 0x0) {
+			continue;
+		}
+
+		std::string texturename = "tpl: texture " + std::to_string(texturenumber) + ": ";
+		if (offset < tplheaderend || offset >= tpl.size()) {
+			problems.push_back(texturename + "data offset " + hexString(offset) + " is outside the data area");
+			continue;
+		}
+		if (offset < previousstart) {
+			problems.push_back(texturename + "data offset " + hexString(offset) + " overlaps the previous texture");
+			continue;
+		}
+		previousstart = offset;
+
+		// Texture data ends where the next non empty texture starts
+		uint32_t end = tpl.size();
+		for (uint32_t nexttexture = texturenumber + 1; nexttexture < textureamount; nexttexture++) {
+			uint32_t nextoffset = bufferIntPluck(tpl, 0x4 + 0x10 * nexttexture + 0x04);
+			if (nextoffset != 0x0) {
+				end = std::max(std::min(nextoffset, end), offset);
+				break;
+			}
+		}
+
+		uint32_t format = bufferIntPluck(tpl, headerposition);
+		uint64_t datalength = textureDataLength(format, bufferShortPluck(tpl, headerposition + 0x08), bufferShortPluck(tpl, headerposition + 0x0A), bufferShortPluck(tpl, headerposition + 0x0C));
+		if (datalength > end - offset) {
+			problems.push_back(texturename + "needs " + hexString(datalength) + " bytes but only " + hexString(end - offset) + " are available");
+			continue;
+		}
+		textureusable[texturenumber] = true;
+	}
+
+	// GMA header entries and names
+	std::vector<GmaModel> models;
+	if (gma.size() < 0x8) {
+		problems.push_back("gma: file is too short for a header");
+	} else {
+		uint32_t modelamount = bufferIntPluck(gma, 0x0);
+		uint32_t headerlength = bufferIntPluck(gma, 0x4);
+		if (headerlength < 0x8 || headerlength > gma.size()) {
+			problems.push_back("gma: header length " + hexString(headerlength) + " is outside the file");
+			headerlength = std::max<uint32_t>(std::min<size_t>(headerlength, gma.size()), 0x8);
+		}
+		if (modelamount > (headerlength - 0x8) / 0x8) {
+			problems.push_back("gma: " + std::to_string(modelamount) + " model entries run past the end of the header");
+			modelamount = (headerlength - 0x8) / 0x8;
+		}
+		uint32_t nameliststart = 0x8 + 0x8 * modelamount;
+
+		for (uint32_t headerentry = 0; headerentry < modelamount; headerentry++) {
+			uint32_t dataoffset = bufferIntPluck(gma, 0x8 + 0x8 * headerentry);
+			if (dataoffset == 0xffffffff) {
+				continue;
+			}
+
+			std::string entryname = "gma: model entry " + std::to_string(headerentry) + ": ";
+			uint32_t nameoffset = bufferIntPluck(gma, 0xC + 0x8 * headerentry);
+			if (nameoffset >= headerlength - nameliststart) {
+				problems.push_back(entryname + "name offset " + hexString(nameoffset) + " is outside the name list");
+				continue;
+			}
+			uint32_t nameend = nameliststart + nameoffset;
+			while (nameend < headerlength && gma[nameend] != '\0') {
+				nameend++;
+			}
+			if (nameend == headerlength) {
+				problems.push_back(entryname + "name isn't terminated before the end of the header");
+				continue;
+			}
+			if (dataoffset >= gma.size() - headerlength) {
+				problems.push_back(entryname + "data offset " + hexString(dataoffset) + " is past the end of the file");
+				continue;
+			}
+			if (models.empty() == false && headerlength + dataoffset <= models.back().start) {
+				problems.push_back(entryname + "data offset " + hexString(dataoffset) + " overlaps the previous model");
+				continue;
+			}
+
+			GmaModel model;
+			model.headerentry = headerentry;
+			model.name.assign(reinterpret_cast<const char*>(&gma[nameliststart + nameoffset]), nameend - nameliststart - nameoffset);
+			model.start = headerlength + dataoffset;
+			model.end = gma.size();
+			model.materialamount = 0;
+			if (models.empty() == false) {
+				models.back().end = model.start;
+			}
+			models.push_back(model);
+		}
+	}
+	modelamountchecked += models.size();
+
+	// Model headers and material entries, checked in parallel
+	std::vector<std::vector<std::string>> modelproblems(models.size());
+	parallelFor(models.size(), [&](size_t modelnumber) {
+		const GmaModel& model = models[modelnumber];
+		std::vector<std::string>& found = modelproblems[modelnumber];
+		std::string modelname = "gma: model entry " + std::to_string(model.headerentry) + " (" + model.name + "): ";
+
+		uint32_t modellength = model.end - model.start;
+		if (modellength < 0x40) {
+			found.push_back(modelname + "only " + hexString(modellength) + " bytes, too short for a model header");
+			return;
+		}
+		if (memcmp(&gma[model.start], "GCMF", 4) != 0) {
+			found.push_back(modelname + "model header doesn't start with GCMF");
+		}
+
+		uint16_t materialamount = bufferShortPluck(gma, model.start + 0x18);
+		if (0x40 + 0x20 * uint32_t(materialamount) > modellength) {
+			found.push_back(modelname + std::to_string(materialamount) + " materials run past the end of the model");
+			return;
+		}
+
+		for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++) {
+			uint16_t textureindex = bufferShortPluck(gma, model.start + 0x44 + 0x20 * materialnumber);
+			std::string materialname = modelname + "material " + std::to_string(materialnumber) + ": ";
+			if (textureindex >= textureamount) {
+				found.push_back(materialname + "texture index " + std::to_string(textureindex) + " is past the end of the tpl (" + std::to_string(textureamount) + " textures)");
+			} else if (textureusable[textureindex] == false) {
+				found.push_back(materialname + "texture index " + std::to_string(textureindex) + " points to an empty or broken texture");
+			}
+		}
+	});
+
+	for (std::vector<std::string>& found : modelproblems) {
+		problems.insert(problems.end(), found.begin(), found.end());
+	}
+	for (std::string& problem : problems) {
+		std::cout << filename << "." << problem << std::endl;
+	}
+	return problems.size();
+}
+
+int archiveValidate(std::vector<std::string> filenames) {
+	size_t problemamount = 0;
+	size_t badarchiveamount = 0;
+	size_t modelamount = 0;
+	size_t textureamount = 0;
+
+	// The next pair is read while the current one is checked
+	IoQueue queue;
+	ioQueueOpen(queue);
+	ArchiveRead next = archiveRead(queue, filenames[0]);
+	for (size_t filenumber = 0; filenumber < filenames.size(); filenumber++) {
+		ArchiveRead current = next;
+		if (filenumber + 1 < filenames.size()) {
+			next = archiveRead(queue, filenames[filenumber + 1]);
+		}
+		size_t found = validateArchive(queue, current, modelamount, textureamount);
+		problemamount += found;
+		if (found != 0) {
+			badarchiveamount++;
+		}
+	}
+	ioQueueClose(queue);
+
+	std::cout << "Checked " << filenames.size() << " archives (" << modelamount << " models, " << textureamount << " textures): "
+		<< problemamount << " problems in " << badarchiveamount << " archives" << std::endl;
+	return problemamount == 0 ? 0 : 1;
+}
+
+/*
+
+	Part 7:
+	Streaming
+
+	Stream modes read and write a single container instead of a <name>.gma / <name>.tpl pair, so gmatool can sit in a pipeline.
+	Any path can be "-" for stdin / stdout. Inputs are read fully into memory and outputs are written in one go, in order.
+
+	Container layout (big endian):
+	0x00 "GMTP"
+	0x04 GMA length
+	0x08 TPL length
+	0x0C 0
+	0x10 GMA data, then TPL data
+
+*/
+
+// Data goes to stdout in stream modes, so messages (including "Done!") are moved to stderr
+// Returns stdout's own buffer for writing data to
+std::streambuf* keepStdoutForData(std::string outpath) {
+	std::streambuf* stdoutbuffer = std::cout.rdbuf();
+	if (outpath == "-") {
+		std::cout.rdbuf(std::cerr.rdbuf());
+	}
+	return stdoutbuffer;
+}
+
+bool streamRead(std::string path, std::string& data) {
+	if (path == "-") {
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+		return std::cin.bad() == false;
+	}
+
+	std::ifstream bif(path, std::ios::binary);
+	if (bif.good() == false) {
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(bif), std::istreambuf_iterator<char>());
+	return bif.bad() == false;
+}
+
+bool streamWrite(std::string path, const std::string& data) {
+	if (path == "-") {
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		return fwrite(data.data(), 1, data.size(), stdout) == data.size() && fflush(stdout) == 0;
+	}
+
+	std::ofstream bof(path, std::ios::binary | std::ios::trunc);
+	bof.write(data.data(), data.size());
+	bof.close();
+	return bof.good();
+}
+
+bool readContainer(std::string path, std::string& gma, std::string& tpl) {
+	std::string container;
+	if (streamRead(path, container) == false) {
+		std::cout << "Couldn't read " << path << "!" << std::endl;
+		return false;
+	}
+
+	std::istringstream header(container);
+	if (container.size() < 0x10 || container.compare(0, 4, "GMTP") != 0) {
+		std::cout << path << " isn't a gmatool stream!" << std::endl;
+		return false;
+	}
+	uint32_t gmalength = fileIntPluck(header, 0x04);
+	uint32_t tpllength = fileIntPluck(header, 0x08);
+	if (uint64_t(gmalength) + tpllength > container.size() - 0x10) {
+		std::cout << path << " is truncated!" << std::endl;
+		return false;
+	}
+
+	gma = container.substr(0x10, gmalength);
+	tpl = container.substr(0x10 + gmalength, tpllength);
+	return true;
+}
+
+bool writeContainer(std::string path, const std::string& gma, const std::string& tpl) {
+	std::ostringstream container;
+	container << "GMTP";
+	saveIntToFileEnd(container, gma.size());
+	saveIntToFileEnd(container, tpl.size());
+	saveIntToFileEnd(container, 0x0);
+	container << gma << tpl;
+
+	if (streamWrite(path, container.str()) == false) {
+		std::cout << "Couldn't write " << path << "!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// <name>.gma and <name>.tpl into one stream
+int streamPack(std::string filename, std::string outpath) {
+	keepStdoutForData(outpath);
+
+	std::string gma;
+	std::string tpl;
+	if (streamRead(filename + ".gma", gma) == false) {
+		std::cout << "No GMA found!" << std::endl;
+		return -1;
+	}
+	if (streamRead(filename + ".tpl", tpl) == false) {
+		std::cout << "No TPL found!" << std::endl;
+		return -1;
+	}
+	return writeContainer(outpath, gma, tpl) ? 0 : -1;
+}
+
+// One stream back out to <name>.gma and <name>.tpl
+int streamUnpack(std::string inpath, std::string filename) {
+	std::string gma;
+	std::string tpl;
+	if (readContainer(inpath, gma, tpl) == false) {
+		return -1;
+	}
+	if (streamWrite(filename + ".gma", gma) == false || streamWrite(filename + ".tpl", tpl) == false) {
+		std::cout << "Couldn't write " << filename << ".gma / " << filename << ".tpl!" << std::endl;
+		return -1;
+	}
+	std::cout << "saved to " << filename << std::endl;
+	return 0;
+}
+
+// Same as -me, from one stream to another
+int streamModelExtract(std::string inpath, std::string specificmodel, std::string outpath) {
+	keepStdoutForData(outpath);
+
+	std::string gmadata;
+	std::string tpldata;
+	if (readContainer(inpath, gmadata, tpldata) == false) {
+		return -1;
+	}
+	std::istringstream gma(gmadata);
+	std::istringstream tpl(tpldata);
+
+	uint32_t modelamount = fileIntPluck(gma, 0);
+	uint32_t nonemptymodelamount = modelAmountWithoutEmpties(gma, modelamount);
+	uint32_t modellistpointer = modelamount * 0x8 + 0x8;
+
+	for (size_t modelnumber = 0; modelnumber < nonemptymodelamount; modelnumber++) {
+
+		// Read model name from model list
+		uint32_t modelnamelength = getModelNameLength(gma, modellistpointer);
+		std::string modelname = readNameFromGma(gma, modellistpointer, modelnamelength);
+
+		if (modelname == specificmodel) {
+			std::ostringstream newgma;
+			std::ostringstream newtpl;
+			modelWriteToStreams(gma, tpl, modelamount, modelNumberWithEmpties(gma, modelnumber), modelnamelength, modelname, newgma, newtpl);
+			if (writeContainer(outpath, newgma.str(), newtpl.str()) == false) {
+				return -1;
+			}
+			std::cout << modelname << " saved to " << outpath << std::endl;
+			return 0;
+		}
+
+		// advance to next model
+		modellistpointer += modelnamelength;
+	}
+
+	std::cout << "The model " << specificmodel << " wasn't found!" << std::endl;
+	return 1;
+}
+
+// Same as -m, from two streams to one
+int streamMerge(std::string inpath1, std::string inpath2, std::string outpath) {
+	keepStdoutForData(outpath);
+
+	if (inpath1 == "-" && inpath2 == "-") {
+		std::cout << "Only one input can be read from stdin!" << std::endl;
+		return -1;
+	}
+
+	std::string gma1data;
+	std::string tpl1data;
+	std::string gma2data;
+	std::string tpl2data;
+	if (readContainer(inpath1, gma1data, tpl1data) == false || readContainer(inpath2, gma2data, tpl2data) == false) {
+		return -1;
+	}
+	std::istringstream gma1(gma1data);
+	std::istringstream tpl1(tpl1data);
+	std::istringstream gma2(gma2data);
+	std::istringstream tpl2(tpl2data);
+
+	std::ostringstream newgma;
+	std::ostringstream newtpl;
+	gmatplMergeStreams(gma1, tpl1, gma2, tpl2, newgma, newtpl);
+	if (writeContainer(outpath, newgma.str(), newtpl.str()) == false) {
+		return -1;
+	}
+	std::cout << "Merged " << inpath1 << " and " << inpath2 << " to " << outpath << std::endl;
+	return 0;
+}
+
+/*
+
+	Part 8:
+	Extract All Models
+
+*/
+
+// Output suffix for each model, models sharing a name get their header entry added so they don't overwrite each other
+std::vector<std::string> modelSuffixes(const Archive& archive) {
+	std::vector<std::string> suffixes;
+	std::map<std::string, size_t> namecounts;
+	for (const GmaModel& model : archive.models) {
+		if (namecounts[model.name]++ == 0) {
+			suffixes.push_back(model.name);
+		} else {
+			suffixes.push_back(model.name + "_" + std::to_string(model.headerentry));
+		}
+	}
+	return suffixes;
+}
+
+// Outputs of one -ae run, kept until their writes are done so the next pair can be read meanwhile
+struct ExtractReport {
+	std::string filename;
+	bool loaded = false;
+	std::vector<std::string> names;
+	std::vector<std::string> suffixes;
+	std::vector<std::vector<IoRequest*>> writes;
+	std::vector<uint8_t> stored;
+};
+
+// Every model of a pair started by archiveRead to its own gma / tpl pair, queueing the outputs
+// With a texture store, textures go to the store and each model gets a tpr instead of a tpl
+void modelExtractQueued(IoQueue& queue, ArchiveRead& read, TextureStore* store, ExtractReport& report) {
+
+	report.filename = read.filename;
+	Archive archive;
+	report.loaded = archiveReadFinish(queue, read, archive);
+	if (report.loaded == false) {
+		return;
+	}
+	uint32_t modelamount = bufferIntPluck(archive.gma, 0x0);
+
+	report.suffixes = modelSuffixes(archive);
+
+	// Each thread reads the same files in memory through its own stream
+	std::vector<std::string> gmadata(archive.models.size());
+	std::vector<std::string> tpldata(archive.models.size());
+	report.stored.assign(archive.models.size(), 1);
+	parallelFor(archive.models.size(), [&](size_t modelnumber) {
+		const GmaModel& model = archive.models[modelnumber];
+		MemoryStreamBuffer gmabuffer(archive.gma);
+		MemoryStreamBuffer tplbuffer(archive.tpl);
+		std::istream oldgma(&gmabuffer);
+		std::istream oldtpl(&tplbuffer);
+
+		std::ostringstream newgma;
+		std::ostringstream newtpl;
+		modelWriteToStreams(oldgma, oldtpl, modelamount, model.headerentry, model.name.size() + 1, model.name, newgma, newtpl);
+		gmadata[modelnumber] = newgma.str();
+		tpldata[modelnumber] = newtpl.str();
+
+		if (store != nullptr) {
+			std::vector<std::string> hashes;
+			report.stored[modelnumber] = textureStorePut(*store, std::vector<uint8_t>(tpldata[modelnumber].begin(), tpldata[modelnumber].end()), hashes);
+			tpldata[modelnumber].clear();
+			for (std::string& hash : hashes) {
+				tpldata[modelnumber] += hash + "\n";
+			}
+		}
+	});
+
+	// All the writes go out as one batch
+	for (size_t modelnumber = 0; modelnumber < archive.models.size(); modelnumber++) {
+		std::string outname = report.filename + "_" + report.suffixes[modelnumber];
+		report.names.push_back(archive.models[modelnumber].name);
+		report.writes.push_back({
+			&ioWrite(queue, outname + ".gma", std::vector<uint8_t>(gmadata[modelnumber].begin(), gmadata[modelnumber].end())),
+			&ioWrite(queue, outname + (store == nullptr ? ".tpl" : ".tpr"), std::vector<uint8_t>(tpldata[modelnumber].begin(), tpldata[modelnumber].end()))
+		});
+		std::string().swap(gmadata[modelnumber]);
+		std::string().swap(tpldata[modelnumber]);
+	}
+	ioFlush(queue);
+}
+
+// Wait for the outputs of modelExtractQueued and say what was saved
+int modelExtractReport(IoQueue& queue, ExtractReport& report) {
+	if (report.loaded == false) {
+		return -1;
+	}
+
+	int result = 0;
+	for (size_t modelnumber = 0; modelnumber < report.names.size(); modelnumber++) {
+		bool saved = report.stored[modelnumber];
+		for (IoRequest* request : report.writes[modelnumber]) {
+			saved &= ioWait(queue, *request);
+			ioRelease(queue, *request);
+		}
+		if (saved) {
+			std::cout << report.names[modelnumber] << " saved to " << report.filename << "_" << report.suffixes[modelnumber] << std::endl;
+		} else {
+			std::cout << "Couldn't save " << report.filename << "_" << report.suffixes[modelnumber] << "!" << std::endl;
+			result = 1;
+		}
+	}
+	return result;
+}
+
+// Like running -me for each name, but indexing the files once
+int modelExtractAll(std::string filename, TextureStore* store) {
+	IoQueue queue;
+	ioQueueOpen(queue);
+	ArchiveRead read = archiveRead(queue, filename);
+	ExtractReport report;
+	modelExtractQueued(queue, read, store, report);
+	int result = modelExtractReport(queue, report);
+	ioQueueClose(queue);
+	return result;
+}
+
+/*
+
+	Part 9:
+	Texture Store
+
+	A directory of textures named by content hash, shared by a batch of extractions so each texture is only written once.
+	Each <hash>.tex is the 0x10 byte tpl header entry (with a zero offset) followed by the texture data.
+	Extracted models get a <name>_<modelname>.tpr listing their textures' hashes in order, which -tb turns back into a tpl.
+
+*/
+
+bool textureStoreOpen(std::string path, TextureStore& store) {
+	std::error_code error;
+	std::filesystem::create_directories(path, error);
+	if (std::filesystem::is_directory(path, error) == false) {
+		std::cout << "Couldn't open texture store " << path << "!" << std::endl;
+		return false;
+	}
+
+	store.path = path;
+	for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(path, error)) {
+		if (entry.path().extension() == ".tex") {
+			store.known.insert(entry.path().stem().string());
+		}
+	}
+	return true;
+}
+
+// Split a tpl into store entries, writing the ones the store doesn't have yet, and list their hashes in order
+bool textureStorePut(TextureStore& store, const std::vector<uint8_t>& tpl, std::vector<std::string>& hashes) {
+	std::vector<TplTexture> textures;
+	if (indexTpl(tpl, textures) == false) {
+		return false;
+	}
+
+	hashes.clear();
+	for (size_t texturenumber = 0; texturenumber < textures.size(); texturenumber++) {
+		const TplTexture& texture = textures[texturenumber];
+		std::vector<uint8_t> entry(tpl.begin() + 0x4 + 0x10 * texturenumber, tpl.begin() + 0x14 + 0x10 * texturenumber);
+		memset(&entry[0x4], 0x0, 4);
+		entry.insert(entry.end(), tpl.begin() + texture.offset, tpl.begin() + texture.offset + texture.length);
+
+		std::string hash = hashString(hash64(entry.data(), entry.size()));
+		hashes.push_back(hash);
+
+		bool isnew;
+		{
+			std::lock_guard<std::mutex> guard(store.lock);
+			isnew = store.known.insert(hash).second;
+			store.referenced++;
+			if (isnew) {
+				store.written++;
+			}
+		}
+		if (isnew) {
+			// Written under a temporary name first, so an interrupted write never leaves a bad file under a valid hash
+			std::string texturepath = store.path + "/" + hash + ".tex";
+			std::ofstream texturefile(texturepath + ".tmp", std::ios::binary | std::ios::trunc);
+			texturefile.write(reinterpret_cast<const char*>(entry.data()), entry.size());
+			texturefile.close();
+			std::error_code error;
+			if (texturefile.good()) {
+				std::filesystem::rename(texturepath + ".tmp", texturepath, error);
+			}
+			if (texturefile.good() == false || error) {
+				std::filesystem::remove(texturepath + ".tmp", error);
+				std::lock_guard<std::mutex> guard(store.lock);
+				store.known.erase(hash);
+				store.written--;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Rebuild <name>.tpl from <name>.tpr, laid out exactly as the extraction wrote it
+int textureStoreBuild(std::string storepath, std::string filename) {
+
+	std::ifstream references(filename + ".tpr");
+	if (references.good() == false) {
+		std::cout << "No TPR found! (" << filename << ".tpr)" << std::endl;
+		return -1;
+	}
+
+	std::vector<std::vector<uint8_t>> entries;
+	std::string hash;
+	while (references >> hash) {
+		entries.emplace_back();
+		if (loadFile(storepath + "/" + hash + ".tex", entries.back()) == false || entries.back().size() < 0x10) {
+			std::cout << "Texture " << hash << " is missing from " << storepath << "!" << std::endl;
+			return -1;
+		}
+	}
+
+	std::ofstream newtpl(filename + ".tpl", std::ios::binary | std::ios::trunc);
+	uint32_t textureamount = entries.size();
+	saveIntToFileEnd(newtpl, textureamount);
+
+	// The first offset is the header length, aligned to 0x20 bytes
+	uint32_t rollingoffset = (textureamount + 1) * 0x10;
+	if (rollingoffset % 0x20 != 0x0) {
+		rollingoffset += 0x10;
+	}
+	for (std::vector<uint8_t>& entry : entries) {
+		newtpl.write(reinterpret_cast<const char*>(entry.data()), 0x4);
+		saveIntToFileEnd(newtpl, rollingoffset);
+		newtpl.write(reinterpret_cast<const char*>(entry.data() + 0x8), 0x8);
+		rollingoffset += entry.size() - 0x10;
+	}
+
+	//padding with the 00010203... pattern
+	uint8_t tplpaddingamount = (0x10 * textureamount - 0x04) % 0x20;
+	for (uint8_t tplpaddingpointer = 0; tplpaddingpointer < tplpaddingamount; tplpaddingpointer++) {
+		newtpl << tplpaddingpointer;
+	}
+
+	for (std::vector<uint8_t>& entry : entries) {
+		newtpl.write(reinterpret_cast<const char*>(entry.data() + 0x10), entry.size() - 0x10);
+	}
+	newtpl.close();
+
+	std::cout << "Rebuilt " << filename << ".tpl from " << textureamount << " stored textures" << std::endl;
+	return 0;
+}
+
+// -ae for a batch of files, sharing one texture store
+int modelExtractAllToStore(std::string storepath, std::vector<std::string> filenames) {
+	TextureStore store;
+	if (textureStoreOpen(storepath, store) == false) {
+		return -1;
+	}
+
+	// While one pair is extracted, the next is read and the previous one's outputs are written
+	IoQueue queue;
+	ioQueueOpen(queue);
+	ArchiveRead next = archiveRead(queue, filenames[0]);
+	ExtractReport previous;
+	previous.loaded = true;
+
+	int result = 0;
+	for (size_t filenumber = 0; filenumber < filenames.size(); filenumber++) {
+		ArchiveRead current = next;
+		if (filenumber + 1 < filenames.size()) {
+			next = archiveRead(queue, filenames[filenumber + 1]);
+		}
+		if (modelExtractReport(queue, previous) != 0) {
+			result = 1;
+		}
+		previous = ExtractReport();
+		modelExtractQueued(queue, current, &store, previous);
+	}
+	if (modelExtractReport(queue, previous) != 0) {
+		result = 1;
+	}
+	ioQueueClose(queue);
+
+	std::cout << store.referenced << " texture references, " << store.written << " new textures written to " << storepath << std::endl;
+	return result;
+}
+
+/*
+
+	Part 10:
+	Watch Mode
+
+	Merges two gma / tpl pairs like -m, then rebuilds the output whenever one of the inputs is written.
+	The first pair's gma and tpl data get a reserved length (their size plus the slack) and are padded with zeroes up to it,
+	so edits that fit in the slack don't move anything after them. The outputs are compared chunk by chunk with the last
+	build and only the chunks that changed are written. Anything bigger than the slack causes a full rebuild.
+
+*/
+
+#define WATCH_CHUNK_LENGTH 0x10000
+
+// One merged output file and the hash of each chunk last written to it
+struct WatchOutput {
+	std::string path;
+	size_t length = 0;
+	std::vector<uint64_t> chunkhashes;
+};
+
+// Write the chunks of data that differ from the last build, returns the number of bytes written
+size_t watchWriteOutput(WatchOutput& output, const std::string& data, bool full) {
+	std::vector<uint64_t> chunkhashes;
+	for (size_t position = 0; position < data.size(); position += WATCH_CHUNK_LENGTH) {
+		size_t chunklength = std::min<size_t>(WATCH_CHUNK_LENGTH, data.size() - position);
+		chunkhashes.push_back(hash64(reinterpret_cast<const uint8_t*>(data.data()) + position, chunklength));
+	}
+
+	size_t written = 0;
+	std::error_code error;
+	if (full || std::filesystem::exists(output.path, error) == false) {
+		std::ofstream bof(output.path, std::ios::binary | std::ios::trunc);
+		bof.write(data.data(), data.size());
+		written = data.size();
+	} else {
+		std::fstream bof(output.path, std::ios::binary | std::ios::in | std::ios::out);
+		for (size_t chunknumber = 0; chunknumber < chunkhashes.size(); chunknumber++) {
+			if (chunknumber < output.chunkhashes.size() && chunkhashes[chunknumber] == output.chunkhashes[chunknumber]) {
+				continue;
+			}
+			size_t position = chunknumber * WATCH_CHUNK_LENGTH;
+			size_t chunklength = std::min<size_t>(WATCH_CHUNK_LENGTH, data.size() - position);
+			bof.seekp(position, bof.beg);
+			bof.write(data.data() + position, chunklength);
+			written += chunklength;
+		}
+		bof.close();
+		if (data.size() < output.length) {
+			std::filesystem::resize_file(output.path, data.size(), error);
+		}
+	}
+
+	output.length = data.size();
+	output.chunkhashes.swap(chunkhashes);
+	return written;
+}
+
+// Pad the first pair's data to its reserved length, or reserve a new one when it has outgrown it
+// Returns true when the reservation had to change
+bool watchReserve(std::vector<uint8_t>& data, uint32_t& reservedlength, uint32_t slack) {
+	bool changed = false;
+	if (data.size() > reservedlength) {
+		// Offsets are 32 bit, so the reserved length can't grow past that
+		reservedlength = std::max<uint64_t>(data.size(), std::min<uint64_t>(uint64_t(data.size()) + slack, 0xffffffe0));
+		changed = true;
+	}
+	data.resize(reservedlength, 0x0);
+	return changed;
+}
+
+// Block until one of the paths is written or replaced
+void watchWait(int notifier, const std::vector<std::string>& paths, std::vector<std::filesystem::file_time_type>& modifiedtimes) {
+	std::error_code error;
+#ifdef __linux__
+	if (notifier >= 0) {
+		bool changed = false;
+		int timeout = -1;
+		char buffer[0x1000];
+
+		// Once something changed, keep reading until editors have finished writing
+		while (true) {
+			pollfd pollnotifier = {notifier, POLLIN, 0};
+			if (poll(&pollnotifier, 1, timeout) <= 0) {
+				if (changed) {
+					return;
+				}
+				continue;
+			}
+
+			ssize_t length = read(notifier, buffer, sizeof(buffer));
+			for (ssize_t position = 0; position < length;) {
+				inotify_event* event = reinterpret_cast<inotify_event*>(buffer + position);
+				position += sizeof(inotify_event) + event->len;
+				for (const std::string& path : paths) {
+					if (event->len > 0 && std::filesystem::path(path).filename() == event->name) {
+						changed = true;
+					}
+				}
+			}
+			if (changed) {
+				timeout = 200;
+			}
+		}
+	}
+#endif
+
+	// No inotify, poll modification times instead
+	while (true) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		bool changed = false;
+		for (size_t pathnumber = 0; pathnumber < paths.size(); pathnumber++) {
+			std::filesystem::file_time_type modifiedtime = std::filesystem::last_write_time(paths[pathnumber], error);
+			if (modifiedtime != modifiedtimes[pathnumber]) {
+				modifiedtimes[pathnumber] = modifiedtime;
+				changed = true;
+			}
+		}
+		if (changed) {
+			return;
+		}
+	}
+}
+
+int gmatplWatch(std::string filename1, std::string filename2, uint32_t slack) {
+
+	// Keep data aligned, main doesn't allow a slack that would wrap here
+	slack = (slack + 0x1f) & ~0x1f;
+
+	std::vector<std::string> paths = {filename1 + ".gma", filename1 + ".tpl", filename2 + ".gma", filename2 + ".tpl"};
+	std::string outname = filename1 + "+" + std::filesystem::path(filename2).filename().string();
+	WatchOutput gmaoutput;
+	WatchOutput tploutput;
+	gmaoutput.path = outname + ".gma";
+	tploutput.path = outname + ".tpl";
+
+	int notifier = -1;
+#ifdef __linux__
+	// Watch the directories, editors often save by replacing the file
+	notifier = inotify_init1(IN_CLOEXEC);
+	for (const std::string& path : paths) {
+		std::string directory = std::filesystem::path(path).parent_path().string();
+		inotify_add_watch(notifier, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	}
+#endif
+	std::error_code error;
+	std::vector<std::filesystem::file_time_type> modifiedtimes;
+	for (const std::string& path : paths) {
+		modifiedtimes.push_back(std::filesystem::last_write_time(path, error));
+	}
+
+	uint32_t gma1reserved = 0;
+	uint32_t tpl1reserved = 0;
+	bool firstbuild = true;
+
+	std::cout << "Watching " << filename1 << " and " << filename2 << " (slack " << hexString(slack) << " bytes), writing to " << outname << std::endl;
+	while (true) {
+		Archive archive1;
+		Archive archive2;
+		if (loadArchive(filename1, archive1) && loadArchive(filename2, archive2)) {
+
+			bool full = firstbuild;
+			full |= watchReserve(archive1.gma, gma1reserved, slack);
+			full |= watchReserve(archive1.tpl, tpl1reserved, slack);
+
+			MemoryStreamBuffer gma1buffer(archive1.gma);
+			MemoryStreamBuffer tpl1buffer(archive1.tpl);
+			MemoryStreamBuffer gma2buffer(archive2.gma);
+			MemoryStreamBuffer tpl2buffer(archive2.tpl);
+			std::istream gma1(&gma1buffer);
+			std::istream tpl1(&tpl1buffer);
+			std::istream gma2(&gma2buffer);
+			std::istream tpl2(&tpl2buffer);
+			std::ostringstream newgma;
+			std::ostringstream newtpl;
+			gmatplMergeStreams(gma1, tpl1, gma2, tpl2, newgma, newtpl);
+
+			std::string gmadata = newgma.str();
+			std::string tpldata = newtpl.str();
+			size_t written = watchWriteOutput(gmaoutput, gmadata, full) + watchWriteOutput(tploutput, tpldata, full);
+			std::cout << (full ? "Full rebuild: " : "Rebuilt: ") << "wrote " << written << " of " << gmadata.size() + tpldata.size() << " bytes" << std::endl;
+			firstbuild = false;
+		} else {
+			std::cout << "Waiting for the inputs to be fixed..." << std::endl;
+		}
+
+		watchWait(notifier, paths, modifiedtimes);
+	}
+}
+
+/*
+
+	Part 11:
+	Metadata Dump
+
+	Reads only the gma header, the model and material headers and the tpl header, and writes what it finds straight to
+	stdout as it goes, so huge archives are never held in memory.
+
+	Binary layout (big endian):
+	"GMAI", version, tpl length, texture count
+	Per texture: format, offset, size, width (16 bit), height (16 bit), mipmaps (16 bit), 0 (16 bit)
+	gma length, header length, header entry count
+	Per header entry: 0xffffffff if empty, otherwise offset, size, material count (16 bit), name length (16 bit), name,
+	then per material: flags, texture index (16 bit), 0 (16 bit)
+
+*/
+
+// Read a block of a file into memory, false if it runs past the end
+bool readBlock(std::istream& bif, uint32_t offset, uint32_t length, std::vector<uint8_t>& block) {
+	block.resize(length);
+	bif.clear();
+	bif.seekg(offset, bif.beg);
+	bif.read(reinterpret_cast<char*>(block.data()), length);
+	return uint32_t(bif.gcount()) == length;
+}
+
+int metadataDump(std::string filename, std::string format) {
+
+	if (format != "json" && format != "bin") {
+		std::cout << "Unknown metadata format " << format << "! (json or bin)" << std::endl;
+		return -1;
+	}
+
+	std::streambuf* stdoutbuffer = keepStdoutForData("-");
+#ifdef _WIN32
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	std::ostream out(stdoutbuffer);
+
+	std::ifstream gma(filename + ".gma", std::ios::binary);
+	std::ifstream tpl(filename + ".tpl", std::ios::binary);
+	if (gma.good() == false) {
+		std::cout << "No GMA found!" << std::endl;
+		return -1;
+	}
+	if (tpl.good() == false) {
+		std::cout << "No TPL found!" << std::endl;
+		return -1;
+	}
+	uint32_t gmalength = getFileLength(gma);
+	uint32_t tpllength = getFileLength(tpl);
+
+	// TPL header, the count is checked against the file length before the entries are read
+	std::vector<uint8_t> tplheader;
+	if (readBlock(tpl, 0x0, 0x4, tplheader) == false || 0x4 + 0x10 * uint64_t(bufferIntPluck(tplheader, 0x0)) > tpllength
+		|| readBlock(tpl, 0x0, 0x4 + 0x10 * bufferIntPluck(tplheader, 0x0), tplheader) == false) {
+		std::cout << "TPL header is corrupted! (" << filename << ".tpl)" << std::endl;
+		return -1;
+	}
+	uint32_t textureamount = bufferIntPluck(tplheader, 0x0);
+
+	if (format == "json") {
+		out << "{\n\t\"tpl\": {\"file\": " << jsonString(filename + ".tpl") << ", \"length\": " << tpllength << ", \"textures\": [";
+	} else {
+		out << "GMAI";
+		saveIntToFileEnd(out, 1); // version
+		saveIntToFileEnd(out, tpllength);
+		saveIntToFileEnd(out, textureamount);
+	}
+
+	uint32_t nextstart = tpllength;
+	std::vector<uint32_t> textureends(textureamount, 0);
+	for (uint32_t texturenumber = textureamount; texturenumber-- > 0;) {
+		uint32_t offset = bufferIntPluck(tplheader, 0x4 + 0x10 * texturenumber + 0x04);
+		if (offset != 0x0) {
+			textureends[texturenumber] = std::max(nextstart, offset);
+			nextstart = offset;
+		}
+	}
+
+	for (uint32_t texturenumber = 0; texturenumber < textureamount; texturenumber++) {
+		uint32_t headerposition = 0x4 + 0x10 * texturenumber;
+		uint32_t textureformat = bufferIntPluck(tplheader, headerposition);
+		uint32_t offset = bufferIntPluck(tplheader, headerposition + 0x04);
+		uint32_t length = (offset == 0x0) ? 0 : textureends[texturenumber] - offset;
+		uint16_t width = bufferShortPluck(tplheader, headerposition + 0x08);
+		uint16_t height = bufferShortPluck(tplheader, headerposition + 0x0A);
+		uint16_t mipmaps = bufferShortPluck(tplheader, headerposition + 0x0C);
+
+		if (format == "json") {
+			out << (texturenumber == 0 ? "\n" : ",\n")
+				<< "\t\t{\"index\": " << texturenumber << ", \"format\": " << textureformat << ", \"offset\": " << offset << ", \"size\": " << length
+				<< ", \"width\": " << width << ", \"height\": " << height << ", \"mipmaps\": " << mipmaps << "}";
+		} else {
+			saveIntToFileEnd(out, textureformat);
+			saveIntToFileEnd(out, offset);
+			saveIntToFileEnd(out, length);
+			saveShortToFileEnd(out, width);
+			saveShortToFileEnd(out, height);
+			saveShortToFileEnd(out, mipmaps);
+			saveShortToFileEnd(out, 0x0);
+		}
+	}
+
+	// GMA header, model table and names together
+	std::vector<uint8_t> gmaheader;
+	if (readBlock(gma, 0x0, 0x8, gmaheader) == false) {
+		std::cout << "GMA header is corrupted! (" << filename << ".gma)" << std::endl;
+		return -1;
+	}
+	uint32_t modelamount = bufferIntPluck(gmaheader, 0x0);
+	uint32_t headerlength = bufferIntPluck(gmaheader, 0x4);
+	uint64_t nameliststart = 0x8 + 0x8 * uint64_t(modelamount);
+	if (headerlength < nameliststart || headerlength > gmalength || readBlock(gma, 0x0, headerlength, gmaheader) == false) {
+		std::cout << "GMA header is corrupted! (" << filename << ".gma)" << std::endl;
+		return -1;
+	}
+
+	if (format == "json") {
+		out << "\n\t]},\n\t\"gma\": {\"file\": " << jsonString(filename + ".gma") << ", \"length\": " << gmalength
+			<< ", \"headerlength\": " << headerlength << ", \"entries\": " << modelamount << ", \"models\": [";
+	} else {
+		saveIntToFileEnd(out, gmalength);
+		saveIntToFileEnd(out, headerlength);
+		saveIntToFileEnd(out, modelamount);
+	}
+
+	bool firstmodel = true;
+	std::vector<uint8_t> modelheader;
+	for (uint32_t headerentry = 0; headerentry < modelamount; headerentry++) {
+		uint32_t dataoffset = bufferIntPluck(gmaheader, 0x8 + 0x8 * headerentry);
+		if (dataoffset == 0xffffffff) {
+			// Keep empty entries in the binary dump so entries line up with the header
+			if (format == "bin") {
+				saveIntToFileEnd(out, 0xffffffff);
+			}
+			continue;
+		}
+
+		// Model ends where the next non empty model starts
+		uint32_t start = headerlength + dataoffset;
+		uint32_t end = gmalength;
+		for (uint32_t nextentry = headerentry + 1; nextentry < modelamount; nextentry++) {
+			uint32_t nextoffset = bufferIntPluck(gmaheader, 0x8 + 0x8 * nextentry);
+			if (nextoffset != 0xffffffff) {
+				end = std::max(headerlength + nextoffset, start);
+				break;
+			}
+		}
+
+		uint32_t namestart = std::min<uint64_t>(nameliststart + bufferIntPluck(gmaheader, 0xC + 0x8 * headerentry), headerlength);
+		uint32_t nameend = namestart;
+		while (nameend < headerlength && gmaheader[nameend] != '\0') {
+			nameend++;
+		}
+		std::string name(gmaheader.begin() + namestart, gmaheader.begin() + nameend);
+
+		uint16_t materialamount = 0;
+		if (readBlock(gma, start, 0x40, modelheader)) {
+			materialamount = bufferShortPluck(modelheader, 0x18);
+			if (readBlock(gma, start + 0x40, 0x20 * materialamount, modelheader) == false) {
+				materialamount = 0;
+			}
+		}
+
+		if (format == "json") {
+			out << (firstmodel ? "\n" : ",\n")
+				<< "\t\t{\"entry\": " << headerentry << ", \"name\": " << jsonString(name) << ", \"offset\": " << start << ", \"size\": " << end - start
+				<< ", \"materials\": [";
+			for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++) {
+				out << (materialnumber == 0 ? "" : ", ")
+					<< "{\"flags\": " << bufferIntPluck(modelheader, 0x20 * materialnumber)
+					<< ", \"texture\": " << bufferShortPluck(modelheader, 0x20 * materialnumber + 0x04) << "}";
+			}
+			out << "]}";
+		} else {
+			saveIntToFileEnd(out, start);
+			saveIntToFileEnd(out, end - start);
+			saveShortToFileEnd(out, materialamount);
+			saveShortToFileEnd(out, name.size());
+			out << name;
+			for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++) {
+				saveIntToFileEnd(out, bufferIntPluck(modelheader, 0x20 * materialnumber));
+				saveShortToFileEnd(out, bufferShortPluck(modelheader, 0x20 * materialnumber + 0x04));
+				saveShortToFileEnd(out, 0x0);
+			}
+		}
+		firstmodel = false;
+	}
+
+	if (format == "json") {
+		out << "\n\t]}\n}\n";
+	}
+	out.flush();
+	return out.good() ? 0 : -1;
+}
+
+/*
+
+	Part 12:
+	Sharding
+
+*/
+
+// Write the given models, in the given order, to a new gma / tpl pair holding only the textures they use
+// Material texture indices are renumbered to match, textures keep their original order
+void subsetWriteToStreams(const Archive& archive, const std::vector<size_t>& modelnumbers, std::ostream& newgma, std::ostream& newtpl) {
+
+	// Find the textures used by these models
+	std::vector<uint8_t> used(archive.textures.size(), 0);
+	for (size_t modelnumber : modelnumbers) {
+		const GmaModel& model = archive.models[modelnumber];
+		for (uint32_t materialnumber = 0; materialnumber < model.materialamount; materialnumber++) {
+			uint16_t textureindex = bufferShortPluck(archive.gma, model.start + 0x44 + 0x20 * materialnumber);
+			if (textureindex < used.size()) {
+				used[textureindex] = 1;
+			}
+		}
+	}
+	std::vector<size_t> texturenumbers;
+	for (size_t texturenumber = 0; texturenumber < used.size(); texturenumber++) {
+		if (used[texturenumber]) {
+			texturenumbers.push_back(texturenumber);
+		}
+	}
+
+	layoutWriteToStreams(archive, modelnumbers, texturenumbers, 1, newgma, newtpl);
+}
+
+// Write the given models and textures, in the given orders, to a new gma / tpl pair
+// Each model and texture starts on a multiple of alignment (1 packs them), the headers are padded to at least 0x20
+// Material texture indices are renumbered to the new texture order, textures that aren't listed must not be used
+void layoutWriteToStreams(const Archive& archive, const std::vector<size_t>& modelnumbers, const std::vector<size_t>& texturenumbers, uint32_t alignment,
+	std::ostream& newgma, std::ostream& newtpl) {
+
+	uint32_t headeralignment = std::max<uint32_t>(alignment, 0x20);
+	std::vector<uint32_t> texturemap(archive.textures.size(), 0xffffffff);
+	for (size_t texturenumber = 0; texturenumber < texturenumbers.size(); texturenumber++) {
+		texturemap[texturenumbers[texturenumber]] = texturenumber;
+	}
+
+	// GMA header, the name list starts after the 0x8 bytes per model
+	uint32_t modelamount = modelnumbers.size();
+	uint32_t namelistlength = 0;
+	for (size_t modelnumber : modelnumbers) {
+		namelistlength += archive.models[modelnumber].name.size() + 1;
+	}
+	uint32_t gmapureheaderlength = 0x8 + 0x8 * modelamount + namelistlength;
+	uint32_t gmapadding = (-gmapureheaderlength) % headeralignment;
+	saveIntToFileEnd(newgma, modelamount);
+	saveIntToFileEnd(newgma, gmapureheaderlength + gmapadding);
+
+	uint32_t dataoffset = 0;
+	uint32_t nameoffset = 0;
+	for (size_t modelnumber : modelnumbers) {
+		const GmaModel& model = archive.models[modelnumber];
+		dataoffset += (-dataoffset) % alignment;
+		saveIntToFileEnd(newgma, dataoffset);
+		saveIntToFileEnd(newgma, nameoffset);
+		dataoffset += model.end - model.start;
+		nameoffset += model.name.size() + 1;
+	}
+	for (size_t modelnumber : modelnumbers) {
+		newgma.write(archive.models[modelnumber].name.c_str(), archive.models[modelnumber].name.size() + 1);
+	}
+	padZeroes(newgma, gmapadding);
+
+	// Model data, with material texture indices renumbered
+	dataoffset = 0;
+	for (size_t modelnumber : modelnumbers) {
+		const GmaModel& model = archive.models[modelnumber];
+		padZeroes(newgma, (-dataoffset) % alignment);
+		dataoffset += (-dataoffset) % alignment;
+
+		const char* modeldata = reinterpret_cast<const char*>(archive.gma.data() + model.start);
+		newgma.write(modeldata, 0x40);
+		for (uint32_t materialnumber = 0; materialnumber < model.materialamount; materialnumber++) {
+			const char* material = modeldata + 0x40 + 0x20 * materialnumber;
+			uint16_t textureindex = bufferShortPluck(archive.gma, model.start + 0x44 + 0x20 * materialnumber);
+			newgma.write(material, 0x04);
+			saveShortToFileEnd(newgma, textureindex < texturemap.size() ? texturemap[textureindex] : textureindex);
+			newgma.write(material + 0x06, 0x1A);
+		}
+		uint32_t materialslength = 0x40 + 0x20 * model.materialamount;
+		newgma.write(modeldata + materialslength, model.end - model.start - materialslength);
+		dataoffset += model.end - model.start;
+	}
+
+	tplWriteToStream(archive, texturenumbers, alignment, newtpl);
+}
+
+// Write the given textures, in the given order, to a new tpl, each starting on a multiple of alignment
+void tplWriteToStream(const Archive& archive, const std::vector<size_t>& texturenumbers, uint32_t alignment, std::ostream& newtpl) {
+
+	// TPL header, padded with the 00010203... pattern
+	uint32_t headeralignment = std::max<uint32_t>(alignment, 0x20);
+	uint32_t textureamount = texturenumbers.size();
+	uint32_t tplpaddingamount = (-(0x04 + 0x10 * textureamount)) % headeralignment;
+	uint32_t rollingoffset = 0x04 + 0x10 * textureamount + tplpaddingamount;
+	saveIntToFileEnd(newtpl, textureamount);
+	for (size_t texturenumber : texturenumbers) {
+		const TplTexture& texture = archive.textures[texturenumber];
+		const char* entry = reinterpret_cast<const char*>(archive.tpl.data() + 0x04 + 0x10 * texturenumber);
+		newtpl.write(entry, 0x04);
+		if (texture.offset == 0x0) {
+			saveIntToFileEnd(newtpl, 0x0);
+		} else {
+			rollingoffset += (-rollingoffset) % alignment;
+			saveIntToFileEnd(newtpl, rollingoffset);
+			rollingoffset += texture.length;
+		}
+		newtpl.write(entry + 0x08, 0x08);
+	}
+	for (uint32_t tplpaddingpointer = 0; tplpaddingpointer < tplpaddingamount; tplpaddingpointer++) {
+		newtpl << uint8_t(tplpaddingpointer);
+	}
+	rollingoffset = 0x04 + 0x10 * textureamount + tplpaddingamount;
+	for (size_t texturenumber : texturenumbers) {
+		const TplTexture& texture = archive.textures[texturenumber];
+		if (texture.offset == 0x0) {
+			continue;
+		}
+		padZeroes(newtpl, (-rollingoffset) % alignment);
+		rollingoffset += (-rollingoffset) % alignment;
+		newtpl.write(reinterpret_cast<const char*>(archive.tpl.data() + texture.offset), texture.length);
+		rollingoffset += texture.length;
+	}
+}
+
+// Texture indices used by a model's materials, without duplicates
+std::vector<uint16_t> modelTextures(const Archive& archive, const GmaModel& model) {
+	std::vector<uint16_t> textureindices;
+	for (uint32_t materialnumber = 0; materialnumber < model.materialamount; materialnumber++) {
+		uint16_t textureindex = bufferShortPluck(archive.gma, model.start + 0x44 + 0x20 * materialnumber);
+		if (textureindex < archive.textures.size() && std::find(textureindices.begin(), textureindices.end(), textureindex) == textureindices.end()) {
+			textureindices.push_back(textureindex);
+		}
+	}
+	return textureindices;
+}
+
+// Split models into shardamount groups of similar model + texture bytes
+// Models sharing a texture stay together unless duplicatetextures is set, in which case they are placed on their own
+std::vector<std::vector<size_t>> shardBalance(const Archive& archive, size_t shardamount, bool duplicatetextures) {
+
+	// Group models that share textures, by joining each model to the first model using each of its textures
+	std::vector<size_t> groupof(archive.models.size());
+	std::vector<size_t> firstuser(archive.textures.size(), SIZE_MAX);
+	std::function<size_t(size_t)> findgroup = [&](size_t modelnumber) {
+		while (groupof[modelnumber] != modelnumber) {
+			modelnumber = groupof[modelnumber] = groupof[groupof[modelnumber]];
+		}
+		return modelnumber;
+	};
+	for (size_t modelnumber = 0; modelnumber < archive.models.size(); modelnumber++) {
+		groupof[modelnumber] = modelnumber;
+		if (duplicatetextures) {
+			continue;
+		}
+		for (uint16_t textureindex : modelTextures(archive, archive.models[modelnumber])) {
+			if (firstuser[textureindex] == SIZE_MAX) {
+				firstuser[textureindex] = modelnumber;
+			} else {
+				groupof[findgroup(modelnumber)] = findgroup(firstuser[textureindex]);
+			}
+		}
+	}
+
+	// Bytes of each group, counting each of its textures once
+	std::map<size_t, std::vector<size_t>> groups;
+	for (size_t modelnumber = 0; modelnumber < archive.models.size(); modelnumber++) {
+		groups[findgroup(modelnumber)].push_back(modelnumber);
+	}
+	std::vector<std::pair<uint64_t, size_t>> groupsizes;
+	for (auto& group : groups) {
+		std::set<uint16_t> textureindices;
+		uint64_t groupsize = 0;
+		for (size_t modelnumber : group.second) {
+			const GmaModel& model = archive.models[modelnumber];
+			groupsize += model.end - model.start;
+			for (uint16_t textureindex : modelTextures(archive, model)) {
+				if (textureindices.insert(textureindex).second) {
+					groupsize += archive.textures[textureindex].length;
+				}
+			}
+		}
+		groupsizes.push_back(std::make_pair(groupsize, group.first));
+	}
+
+	// A group can't be split, so there's no point in more shards than groups
+	if (shardamount > groupsizes.size()) {
+		std::cout << "Models sharing textures only form " << groupsizes.size() << " group(s), making " << groupsizes.size() << " shard(s) instead of " << shardamount << std::endl;
+		shardamount = groupsizes.size();
+	}
+
+	// Largest groups first, each to the smallest shard so far
+	std::sort(groupsizes.rbegin(), groupsizes.rend());
+	std::vector<std::vector<size_t>> shards(shardamount);
+	std::vector<uint64_t> shardsizes(shardamount, 0);
+	for (auto& groupsize : groupsizes) {
+		size_t smallest = std::min_element(shardsizes.begin(), shardsizes.end()) - shardsizes.begin();
+		shardsizes[smallest] += groupsize.first;
+		std::vector<size_t>& group = groups[groupsize.second];
+		shards[smallest].insert(shards[smallest].end(), group.begin(), group.end());
+	}
+
+	// Keep the original model order within each shard
+	for (std::vector<size_t>& shard : shards) {
+		std::sort(shard.begin(), shard.end());
+	}
+	return shards;
+}
+
+// One shard per line of model names, and one more for any models not listed
+bool shardGroups(const Archive& archive, std::string groupspath, std::vector<std::vector<size_t>>& shards) {
+	std::ifstream groupsfile(groupspath);
+	if (groupsfile.good() == false) {
+		std::cout << "Group list not found! (" << groupspath << ")" << std::endl;
+		return false;
+	}
+
+	std::multimap<std::string, size_t> modelsbyname;
+	for (size_t modelnumber = 0; modelnumber < archive.models.size(); modelnumber++) {
+		modelsbyname.insert(std::make_pair(archive.models[modelnumber].name, modelnumber));
+	}
+
+	std::vector<bool> placed(archive.models.size(), false);
+	std::string line;
+	while (std::getline(groupsfile, line)) {
+		std::istringstream names(line);
+		std::vector<size_t> shard;
+		std::string name;
+		while (names >> name) {
+			auto matches = modelsbyname.equal_range(name);
+			if (matches.first == matches.second) {
+				std::cout << "The model " << name << " wasn't found!" << std::endl;
+			}
+			for (auto match = matches.first; match != matches.second; match++) {
+				if (placed[match->second] == false) {
+					placed[match->second] = true;
+					shard.push_back(match->second);
+				}
+			}
+		}
+		if (shard.empty() == false) {
+			shards.push_back(shard);
+		}
+	}
+
+	std::vector<size_t> rest;
+	for (size_t modelnumber = 0; modelnumber < archive.models.size(); modelnumber++) {
+		if (placed[modelnumber] == false) {
+			rest.push_back(modelnumber);
+		}
+	}
+	if (rest.empty() == false) {
+		shards.push_back(rest);
+	}
+	return true;
+}
+
+// shardlist is either a number of shards or a file of model name groups
+int archiveShard(std::string filename, std::string shardlist, bool duplicatetextures) {
+
+	Archive archive;
+	if (loadArchive(filename, archive) == false) {
+		return -1;
+	}
+
+	std::vector<std::vector<size_t>> shards;
+	if (shardlist.find_first_not_of("0123456789") == std::string::npos) {
+		char* shardamountend = nullptr;
+		errno = 0;
+		unsigned long shardamount = strtoul(shardlist.c_str(), &shardamountend, 10);
+		if (shardlist.empty() || *shardamountend != '\0' || errno == ERANGE) {
+			std::cout << "Bad shard count " << shardlist << "!" << std::endl;
+			return -1;
+		}
+		if (shardamount == 0) {
+			std::cout << "Need at least one shard!" << std::endl;
+			return -1;
+		}
+		shards = shardBalance(archive, shardamount, duplicatetextures);
+	} else if (shardGroups(archive, shardlist, shards) == false) {
+		return -1;
+	}
+
+	// Each shard is written on its own thread
+	std::vector<uint64_t> shardsizes(shards.size(), 0);
+	std::vector<uint8_t> saved(shards.size(), 0);
+	parallelFor(shards.size(), [&](size_t shardnumber) {
+		std::string outname = filename + "_shard" + std::to_string(shardnumber);
+		std::ofstream newgma(outname + ".gma", std::ios::binary | std::ios::trunc);
+		std::ofstream newtpl(outname + ".tpl", std::ios::binary | std::ios::trunc);
+		subsetWriteToStreams(archive, shards[shardnumber], newgma, newtpl);
+		shardsizes[shardnumber] = uint64_t(newgma.tellp()) + uint64_t(newtpl.tellp());
+		newgma.close();
+		newtpl.close();
+		saved[shardnumber] = newgma.good() && newtpl.good();
+	});
+
+	int result = 0;
+	for (size_t shardnumber = 0; shardnumber < shards.size(); shardnumber++) {
+		if (saved[shardnumber]) {
+			std::cout << shards[shardnumber].size() << " models (" << shardsizes[shardnumber] << " bytes) saved to " << filename << "_shard" << shardnumber << std::endl;
+		} else {
+			std::cout << "Couldn't save " << filename << "_shard" << shardnumber << "!" << std::endl;
+			result = 1;
+		}
+	}
+	return result;
+}
+
+/*
+
+	Part 13:
+	Geometry Export
+
+	Parses the mesh headers and GX display lists after the material entries and writes each model's triangles as flat
+	little endian buffers: <name>_<modelname>.pos (3 floats per vertex), .nrm (3 floats), .uv (2 floats, first texture
+	coordinate) and .idx (3 uint32 per triangle). Attributes a mesh doesn't have are written as zeroes.
+	Stitching, skinned, effective and 16 bit vertex models aren't supported yet.
+
+*/
+
+// GX attributes in the order they appear in a vertex
+#define GX_VA_PNMTXIDX 0
+#define GX_VA_TEX7MTXIDX 8
+#define GX_VA_POS 9
+#define GX_VA_NRM 10
+#define GX_VA_CLR0 11
+#define GX_VA_CLR1 12
+#define GX_VA_TEX0 13
+#define GX_VA_TEX7 20
+#define GX_VA_NBT 25
+
+// Model section flags
+#define GCMF_16BIT_VERTICES 0x01
+#define GCMF_STITCHING 0x04 // Vertices are blended between the transform matrices, their data isn't in the display lists alone
+#define GCMF_SKIN 0x08
+#define GCMF_EFFECTIVE 0x10
+
+// Mesh display list flags
+#define GCMF_MESH_DL0 0x01
+#define GCMF_MESH_DL1 0x02
+#define GCMF_MESH_EXTRA_DLS 0x0C
+
+// Display list primitives
+#define GX_QUADS 0x80
+#define GX_TRIANGLES 0x90
+#define GX_TRIANGLESTRIP 0x98
+#define GX_TRIANGLEFAN 0xA0
+#define GX_LINES 0xA8
+#define GX_LINESTRIP 0xB0
+#define GX_POINTS 0xB8
+
+// Vertex attributes while they're still big endian, and triangle indices
+struct GeometryBuffers {
+	std::vector<uint8_t> positions;
+	std::vector<uint8_t> normals;
+	std::vector<uint8_t> uvs;
+	std::vector<uint32_t> indices;
+};
+
+// Where the exported attributes sit in one display list vertex, -1 when missing
+struct VertexLayout {
+	uint32_t stride;
+	int position;
+	int normal;
+	int uv;
+};
+
+bool vertexLayout(uint32_t vertexflags, VertexLayout& layout) {
+	layout.stride = 0;
+	layout.position = -1;
+	layout.normal = -1;
+	layout.uv = -1;
+
+	for (int attribute = GX_VA_PNMTXIDX; attribute <= GX_VA_TEX7; attribute++) {
+		bool present = vertexflags & (1 << attribute);
+		if (attribute == GX_VA_NRM) {
+			present |= (vertexflags & (1 << GX_VA_NBT)) != 0;
+		}
+		if (present == false) {
+			continue;
+		}
+
+		if (attribute <= GX_VA_TEX7MTXIDX) {
+			layout.stride += 1;
+		} else if (attribute == GX_VA_POS) {
+			layout.position = layout.stride;
+			layout.stride += 12;
+		} else if (attribute == GX_VA_NRM) {
+			// NBT is the normal followed by the binormal and tangent
+			layout.normal = layout.stride;
+			layout.stride += (vertexflags & (1 << GX_VA_NBT)) ? 36 : 12;
+		} else if (attribute == GX_VA_CLR0 || attribute == GX_VA_CLR1) {
+			layout.stride += 4;
+		} else {
+			if (attribute == GX_VA_TEX0) {
+				layout.uv = layout.stride;
+			}
+			layout.stride += 8;
+		}
+	}
+
+	// Any other attribute would change the vertex size in ways we can't follow
+	uint32_t knownflags = ((1 << (GX_VA_TEX7 + 1)) - 1) | (1 << GX_VA_NBT);
+	return (vertexflags & ~knownflags) == 0 && layout.position >= 0;
+}
+
+// Append the triangles of one display list, strips and fans are turned into triangle lists
+bool displayListParse(const uint8_t* displaylist, uint32_t length, const VertexLayout& layout, GeometryBuffers& buffers) {
+	const uint8_t zeroes[12] = {0};
+	uint32_t position = 0;
+
+	while (position < length) {
+		uint8_t command = displaylist[position];
+		if (command == 0x00) {
+			// NOP, also used as padding
+			position++;
+			continue;
+		}
+
+		uint8_t primitive = command & 0xF8;
+		if (primitive < GX_QUADS || position + 3 > length) {
+			return false;
+		}
+		uint32_t vertexamount = (displaylist[position + 1] << 8) | displaylist[position + 2];
+		position += 3;
+		if (uint64_t(vertexamount) * layout.stride > length - position) {
+			return false;
+		}
+
+		if (primitive == GX_LINES || primitive == GX_LINESTRIP || primitive == GX_POINTS) {
+			position += vertexamount * layout.stride;
+			continue;
+		}
+
+		uint32_t base = buffers.positions.size() / 12;
+		for (uint32_t vertex = 0; vertex < vertexamount; vertex++) {
+			const uint8_t* vertexdata = displaylist + position + vertex * layout.stride;
+			buffers.positions.insert(buffers.positions.end(), vertexdata + layout.position, vertexdata + layout.position + 12);
+			const uint8_t* normal = layout.normal >= 0 ? vertexdata + layout.normal : zeroes;
+			buffers.normals.insert(buffers.normals.end(), normal, normal + 12);
+			const uint8_t* uv = layout.uv >= 0 ? vertexdata + layout.uv : zeroes;
+			buffers.uvs.insert(buffers.uvs.end(), uv, uv + 8);
+		}
+		position += vertexamount * layout.stride;
+
+		std::vector<uint32_t>& indices = buffers.indices;
+		if (primitive == GX_TRIANGLES) {
+			for (uint32_t vertex = 0; vertex + 2 < vertexamount; vertex += 3) {
+				indices.insert(indices.end(), {base + vertex, base + vertex + 1, base + vertex + 2});
+			}
+		} else if (primitive == GX_TRIANGLESTRIP) {
+			// Every other triangle of a strip is flipped to keep the winding
+			for (uint32_t vertex = 0; vertex + 2 < vertexamount; vertex++) {
+				if (vertex % 2 == 0) {
+					indices.insert(indices.end(), {base + vertex, base + vertex + 1, base + vertex + 2});
+				} else {
+					indices.insert(indices.end(), {base + vertex + 1, base + vertex, base + vertex + 2});
+				}
+			}
+		} else if (primitive == GX_TRIANGLEFAN) {
+			for (uint32_t vertex = 1; vertex + 1 < vertexamount; vertex++) {
+				indices.insert(indices.end(), {base, base + vertex, base + vertex + 1});
+			}
+		} else if (primitive == GX_QUADS) {
+			for (uint32_t vertex = 0; vertex + 3 < vertexamount; vertex += 4) {
+				indices.insert(indices.end(), {base + vertex, base + vertex + 1, base + vertex + 2, base + vertex, base + vertex + 2, base + vertex + 3});
+			}
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Read every mesh of a model, problem is set when the model can't be read
+bool modelGeometry(const Archive& archive, const GmaModel& model, GeometryBuffers& buffers, std::string& problem) {
+	const std::vector<uint8_t>& gma = archive.gma;
+
+	uint32_t sectionflags = bufferIntPluck(gma, model.start + 0x04);
+	if (sectionflags & (GCMF_16BIT_VERTICES | GCMF_STITCHING | GCMF_SKIN | GCMF_EFFECTIVE)) {
+		problem = "stitching, skinned, effective and 16 bit vertex models aren't supported";
+		return false;
+	}
+
+	uint32_t meshamount = bufferShortPluck(gma, model.start + 0x1A) + bufferShortPluck(gma, model.start + 0x1C);
+	uint32_t materialsend = model.start + 0x40 + 0x20 * model.materialamount;
+
+	// Meshes start after the transform matrices, which the header length accounts for
+	uint32_t position = model.start + bufferIntPluck(gma, model.start + 0x20);
+	if (position < materialsend || position > model.end) {
+		position = materialsend + 0x30 * gma[model.start + 0x1E];
+		position += (-(position - model.start)) % 0x20;
+	}
+
+	for (uint32_t meshnumber = 0; meshnumber < meshamount; meshnumber++) {
+		if (position + 0x60 > model.end) {
+			problem = "mesh " + std::to_string(meshnumber) + " header runs past the end of the model";
+			return false;
+		}
+
+		uint8_t displaylistflags = gma[position + 0x13];
+		if (displaylistflags & GCMF_MESH_EXTRA_DLS) {
+			problem = "mesh " + std::to_string(meshnumber) + " has extra display lists, which aren't supported";
+			return false;
+		}
+
+		VertexLayout layout;
+		if (vertexLayout(bufferIntPluck(gma, position + 0x1C), layout) == false) {
+			problem = "mesh " + std::to_string(meshnumber) + " has an unsupported vertex format " + hexString(bufferIntPluck(gma, position + 0x1C));
+			return false;
+		}
+
+		position += 0x60;
+		for (int displaylist = 0; displaylist < 2; displaylist++) {
+			if ((displaylistflags & (GCMF_MESH_DL0 << displaylist)) == 0) {
+				continue;
+			}
+			uint32_t length = bufferIntPluck(gma, position - 0x60 + 0x28 + 0x4 * displaylist);
+			if (length > model.end - position || displayListParse(gma.data() + position, length, layout, buffers) == false) {
+				problem = "mesh " + std::to_string(meshnumber) + " display list " + std::to_string(displaylist) + " is corrupted";
+				return false;
+			}
+			position += length;
+		}
+	}
+	return true;
+}
+
+// Reverse the bytes of every 32 bit word, turning the big endian floats little endian
+void swapWords(std::vector<uint8_t>& data) {
+	size_t position = 0;
+#if defined(__SSE2__)
+	for (; position + 16 <= data.size(); position += 16) {
+		__m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&data[position]));
+		words = _mm_or_si128(_mm_srli_epi16(words, 8), _mm_slli_epi16(words, 8));
+		words = _mm_shufflelo_epi16(words, _MM_SHUFFLE(2, 3, 0, 1));
+		words = _mm_shufflehi_epi16(words, _MM_SHUFFLE(2, 3, 0, 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&data[position]), words);
+	}
+#endif
+	for (; position + 4 <= data.size(); position += 4) {
+		std::swap(data[position], data[position + 3]);
+		std::swap(data[position + 1], data[position + 2]);
+	}
+}
+
+int geometryExport(std::string filename) {
+
+	Archive archive;
+	if (loadArchive(filename, archive) == false) {
+		return -1;
+	}
+	std::vector<std::string> suffixes = modelSuffixes(archive);
+
+	std::vector<std::string> problems(archive.models.size());
+	std::vector<size_t> vertexamounts(archive.models.size(), 0);
+	std::vector<size_t> triangleamounts(archive.models.size(), 0);
+	parallelFor(archive.models.size(), [&](size_t modelnumber) {
+		GeometryBuffers buffers;
+		if (modelGeometry(archive, archive.models[modelnumber], buffers, problems[modelnumber]) == false) {
+			return;
+		}
+		swapWords(buffers.positions);
+		swapWords(buffers.normals);
+		swapWords(buffers.uvs);
+		if (isLittleEndian() == false) {
+			for (uint32_t& index : buffers.indices) {
+				index = __builtin_bswap32(index);
+			}
+		}
+
+		std::string outname = filename + "_" + suffixes[modelnumber];
+		std::ofstream positions(outname + ".pos", std::ios::binary | std::ios::trunc);
+		std::ofstream normals(outname + ".nrm", std::ios::binary | std::ios::trunc);
+		std::ofstream uvs(outname + ".uv", std::ios::binary | std::ios::trunc);
+		std::ofstream indices(outname + ".idx", std::ios::binary | std::ios::trunc);
+		positions.write(reinterpret_cast<const char*>(buffers.positions.data()), buffers.positions.size());
+		normals.write(reinterpret_cast<const char*>(buffers.normals.data()), buffers.normals.size());
+		uvs.write(reinterpret_cast<const char*>(buffers.uvs.data()), buffers.uvs.size());
+		indices.write(reinterpret_cast<const char*>(buffers.indices.data()), buffers.indices.size() * 4);
+		positions.close();
+		normals.close();
+		uvs.close();
+		indices.close();
+		if (positions.good() == false || normals.good() == false || uvs.good() == false || indices.good() == false) {
+			problems[modelnumber] = "couldn't save " + outname;
+			return;
+		}
+
+		vertexamounts[modelnumber] = buffers.positions.size() / 12;
+		triangleamounts[modelnumber] = buffers.indices.size() / 3;
+	});
+
+	int result = 0;
+	for (size_t modelnumber = 0; modelnumber < archive.models.size(); modelnumber++) {
+		const GmaModel& model = archive.models[modelnumber];
+		if (problems[modelnumber].empty()) {
+			std::cout << model.name << " (" << vertexamounts[modelnumber] << " vertices, " << triangleamounts[modelnumber] << " triangles) saved to "
+				<< filename << "_" << suffixes[modelnumber] << std::endl;
+		} else {
+			std::cout << model.name << " skipped: " << problems[modelnumber] << std::endl;
+			result = 1;
+		}
+	}
+	return result;
+}
+
+/*
+
+	Part 14:
+	Batched I/O
+
+	Whole file reads and writes go through an IoQueue so batch modes can have many of them in flight at once.
+	Compiled with GMATOOL_IO_URING on Linux, requests are queued on an io_uring and submitted together by ioFlush,
+	so the next input can be read while the current outputs are still being written.
+	Everywhere else, or when the kernel refuses the ring, each request is done with a blocking read or write as it's made.
+
+*/
+
+#define IO_QUEUE_DEPTH 64
+
+bool ioQueueOpen(IoQueue& queue) {
+#if defined(__linux__) && defined(GMATOOL_IO_URING)
+	io_uring_params params;
+	memset(&params, 0x0, sizeof(params));
+	int ring = syscall(__NR_io_uring_setup, IO_QUEUE_DEPTH, &params);
+	if (ring < 0) {
+		return false;
+	}
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+		close(ring);
+		return false;
+	}
+
+	// The submission and completion rings share one mapping, the submission entries have their own
+	size_t sqlength = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	size_t cqlength = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	queue.ringlength = std::max(sqlength, cqlength);
+	void* rings = mmap(nullptr, queue.ringlength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+	if (rings == MAP_FAILED) {
+		close(ring);
+		return false;
+	}
+	queue.entrieslength = params.sq_entries * sizeof(io_uring_sqe);
+	void* entries = mmap(nullptr, queue.entrieslength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+	if (entries == MAP_FAILED) {
+		munmap(rings, queue.ringlength);
+		close(ring);
+		return false;
+	}
+
+	queue.ring = ring;
+	queue.rings = static_cast<uint8_t*>(rings);
+	queue.entries = static_cast<io_uring_sqe*>(entries);
+	queue.sqoffsets = params.sq_off;
+	queue.cqoffsets = params.cq_off;
+	queue.depth = params.sq_entries;
+	return true;
+#else
+	(void)queue;
+	return false;
+#endif
+}
+
+#if defined(__linux__) && defined(GMATOOL_IO_URING)
+uint32_t* ioRingField(IoQueue& queue, uint32_t offset) {
+	return reinterpret_cast<uint32_t*>(queue.rings + offset);
+}
+
+// Queue the next read or write of a request, submitted with the next flush
+void ioQueueEntry(IoQueue& queue, IoRequest& request) {
+	uint32_t tail = *ioRingField(queue, queue.sqoffsets.tail);
+	uint32_t index = tail & *ioRingField(queue, queue.sqoffsets.ring_mask);
+	io_uring_sqe& entry = queue.entries[index];
+	memset(&entry, 0x0, sizeof(entry));
+	entry.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+	entry.fd = request.descriptor;
+	entry.off = request.position;
+	entry.addr = reinterpret_cast<uint64_t>(request.data.data() + request.position);
+	entry.len = std::min<size_t>(request.data.size() - request.position, 0x40000000);
+	entry.user_data = reinterpret_cast<uint64_t>(&request);
+	ioRingField(queue, queue.sqoffsets.array)[index] = index;
+	__atomic_store_n(ioRingField(queue, queue.sqoffsets.tail), tail + 1, __ATOMIC_RELEASE);
+	queue.unsubmitted++;
+	queue.inflight++;
+}
+
+void ioFinishRequest(IoRequest& request, bool good) {
+	close(request.descriptor);
+	request.descriptor = -1;
+	request.done = true;
+	request.good = good;
+}
+
+// Do the rest of a request with blocking reads or writes
+void ioFinishBlocking(IoRequest& request) {
+	while (request.position < request.data.size()) {
+		ssize_t length = request.write
+			? pwrite(request.descriptor, request.data.data() + request.position, request.data.size() - request.position, request.position)
+			: pread(request.descriptor, request.data.data() + request.position, request.data.size() - request.position, request.position);
+		if (length < 0 && errno == EINTR) {
+			continue;
+		}
+		if (length <= 0) {
+			break;
+		}
+		request.position += length;
+	}
+	ioFinishRequest(request, request.position == request.data.size());
+}
+
+// Handle every completion the kernel has posted, waiting for at least one when wait is set
+void ioReap(IoQueue& queue, bool wait) {
+	ioFlush(queue);
+	if (wait) {
+		syscall(__NR_io_uring_enter, queue.ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+	}
+
+	uint32_t head = *ioRingField(queue, queue.cqoffsets.head);
+	uint32_t tail = __atomic_load_n(ioRingField(queue, queue.cqoffsets.tail), __ATOMIC_ACQUIRE);
+	io_uring_cqe* completions = reinterpret_cast<io_uring_cqe*>(queue.rings + queue.cqoffsets.cqes);
+	std::vector<IoRequest*> unfinished;
+	for (; head != tail; head++) {
+		io_uring_cqe& completion = completions[head & *ioRingField(queue, queue.cqoffsets.ring_mask)];
+		IoRequest& request = *reinterpret_cast<IoRequest*>(completion.user_data);
+		queue.inflight--;
+
+		if (completion.res == -EINVAL || completion.res == -EOPNOTSUPP) {
+			// Kernels before 5.6 don't have plain reads and writes on the ring
+			ioFinishBlocking(request);
+		} else if (completion.res == -EINTR || completion.res == -EAGAIN) {
+			unfinished.push_back(&request);
+		} else if (completion.res <= 0) {
+			ioFinishRequest(request, false);
+		} else {
+			request.position += completion.res;
+			if (request.position < request.data.size()) {
+				unfinished.push_back(&request);
+			} else {
+				ioFinishRequest(request, true);
+			}
+		}
+	}
+	__atomic_store_n(ioRingField(queue, queue.cqoffsets.head), head, __ATOMIC_RELEASE);
+
+	// Short reads and writes carry on from where they stopped
+	for (IoRequest* request : unfinished) {
+		ioQueueEntry(queue, *request);
+	}
+}
+#endif
+
+// Read a whole file, the data is valid once ioWait returns
+IoRequest& ioRead(IoQueue& queue, std::string path) {
+	queue.requests.emplace_back();
+	IoRequest& request = queue.requests.back();
+	request.path = path;
+
+#if defined(__linux__) && defined(GMATOOL_IO_URING)
+	if (queue.ring >= 0) {
+		request.descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		struct stat status;
+		if (request.descriptor < 0 || fstat(request.descriptor, &status) != 0) {
+			ioFinishRequest(request, false);
+			return request;
+		}
+		request.data.resize(status.st_size);
+		if (request.data.empty()) {
+			ioFinishRequest(request, true);
+			return request;
+		}
+		while (queue.inflight >= queue.depth) {
+			ioReap(queue, true);
+		}
+		ioQueueEntry(queue, request);
+		return request;
+	}
+#endif
+
+	request.good = loadFile(path, request.data);
+	request.done = true;
+	return request;
+}
+
+// Write data to a whole file, replacing it
+IoRequest& ioWrite(IoQueue& queue, std::string path, std::vector<uint8_t> data) {
+	queue.requests.emplace_back();
+	IoRequest& request = queue.requests.back();
+	request.path = path;
+	request.data = std::move(data);
+	request.write = true;
+
+#if defined(__linux__) && defined(GMATOOL_IO_URING)
+	if (queue.ring >= 0) {
+		request.descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (request.descriptor < 0) {
+			ioFinishRequest(request, false);
+			return request;
+		}
+		if (request.data.empty()) {
+			ioFinishRequest(request, true);
+			return request;
+		}
+		while (queue.inflight >= queue.depth) {
+			ioReap(queue, true);
+		}
+		ioQueueEntry(queue, request);
+		return request;
+	}
+#endif
+
+	std::ofstream bof(path, std::ios::binary | std::ios::trunc);
+	bof.write(reinterpret_cast<const char*>(request.data.data()), request.data.size());
+	bof.close();
+	request.good = bof.good();
+	request.done = true;
+	return request;
+}
+
+// Submit everything queued since the last flush in one go
+void ioFlush(IoQueue& queue) {
+#if defined(__linux__) && defined(GMATOOL_IO_URING)
+	while (queue.unsubmitted != 0) {
+		int submitted = syscall(__NR_io_uring_enter, queue.ring, queue.unsubmitted, 0, 0, nullptr, 0);
+		if (submitted < 0 && errno == EINTR) {
+			continue;
+		}
+		if (submitted <= 0) {
+			// The kernel won't take them, so no completions would ever come: take the entries back and do them blocking
+			uint32_t tail = *ioRingField(queue, queue.sqoffsets.tail) - queue.unsubmitted;
+			for (uint32_t position = tail; position != tail + queue.unsubmitted; position++) {
+				io_uring_sqe& entry = queue.entries[position & *ioRingField(queue, queue.sqoffsets.ring_mask)];
+				ioFinishBlocking(*reinterpret_cast<IoRequest*>(entry.user_data));
+			}
+			__atomic_store_n(ioRingField(queue, queue.sqoffsets.tail), tail, __ATOMIC_RELEASE);
+			queue.inflight -= queue.unsubmitted;
+			queue.unsubmitted = 0;
+			break;
+		}
+		queue.unsubmitted -= submitted;
+	}
+#else
+	(void)queue;
+#endif
+}
+
+bool ioWait(IoQueue& queue, IoRequest& request) {
+#if defined(__linux__) && defined(GMATOOL_IO_URING)
+	while (request.done == false) {
+		ioReap(queue, true);
+	}
+#else
+	(void)queue;
+#endif
+	return request.good;
+}
+
+// Forget a finished request and its data
+void ioRelease(IoQueue& queue, IoRequest& request) {
+	ioWait(queue, request);
+	for (std::list<IoRequest>::iterator it = queue.requests.begin(); it != queue.requests.end(); it++) {
+		if (&*it == &request) {
+			queue.requests.erase(it);
+			return;
+		}
+	}
+}
+
+// Wait for every request, returns false if any of them failed
+bool ioWaitAll(IoQueue& queue) {
+	bool good = true;
+	for (IoRequest& request : queue.requests) {
+		good &= ioWait(queue, request);
+	}
+	return good;
+}
+
+void ioQueueClose(IoQueue& queue) {
+	ioWaitAll(queue);
+	queue.requests.clear();
+#if defined(__linux__) && defined(GMATOOL_IO_URING)
+	if (queue.ring >= 0) {
+		munmap(queue.entries, queue.entrieslength);
+		munmap(queue.rings, queue.ringlength);
+		close(queue.ring);
+		queue.ring = -1;
+	}
+#endif
+}
+
+// Start reading a gma / tpl pair
+ArchiveRead archiveRead(IoQueue& queue, std::string filename) {
+	ArchiveRead read;
+	read.filename = filename;
+	read.gma = &ioRead(queue, filename + ".gma");
+	read.tpl = &ioRead(queue, filename + ".tpl");
+	ioFlush(queue);
+	return read;
+}
+
+// Wait for a pair started by archiveRead and index it like loadArchive
+bool archiveReadFinish(IoQueue& queue, ArchiveRead& read, Archive& archive) {
+	bool gmagood = ioWait(queue, *read.gma);
+	bool tplgood = ioWait(queue, *read.tpl);
+	archive.gma = std::move(read.gma->data);
+	archive.tpl = std::move(read.tpl->data);
+	ioRelease(queue, *read.gma);
+	ioRelease(queue, *read.tpl);
+
+	if (gmagood == false) {
+		std::cout << "GMA not found! (" << read.filename << ".gma)" << std::endl;
+		return false;
+	}
+	if (tplgood == false) {
+		std::cout << "TPL not found! (" << read.filename << ".tpl)" << std::endl;
+		return false;
+	}
+	if (indexGma(archive.gma, archive.models) == false) {
+		std::cout << "GMA header is corrupted! (" << read.filename << ".gma)" << std::endl;
+		return false;
+	}
+	if (indexTpl(archive.tpl, archive.textures) == false) {
+		std::cout << "TPL header is corrupted! (" << read.filename << ".tpl)" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/*
+
+	Part 15:
+	Texture Pruning
+
+	Drops the textures no material of any model references, which merges and hand edits leave behind.
+	The gma is kept byte for byte, empty header entries included, except for the material texture indices,
+	which are remapped to the remaining textures. Those keep their order.
+
+*/
+
+// Textures that no material references
+std::vector<size_t> unreferencedTextures(const Archive& archive) {
+	std::vector<uint8_t> referenced(archive.textures.size(), 0);
+	for (const GmaModel& model : archive.models) {
+		for (uint16_t textureindex : modelTextures(archive, model)) {
+			referenced[textureindex] = 1;
+		}
+	}
+
+	std::vector<size_t> texturenumbers;
+	for (size_t texturenumber = 0; texturenumber < referenced.size(); texturenumber++) {
+		if (referenced[texturenumber] == 0) {
+			texturenumbers.push_back(texturenumber);
+		}
+	}
+	return texturenumbers;
+}
+
+// Write an archive without its unreferenced textures, saying how many were dropped
+void pruneWriteToStreams(const Archive& archive, std::ostream& newgma, std::ostream& newtpl) {
+	std::vector<size_t> unreferenced = unreferencedTextures(archive);
+	uint64_t prunedlength = 0;
+	for (size_t texturenumber : unreferenced) {
+		prunedlength += archive.textures[texturenumber].length;
+	}
+	std::cout << "Pruned " << unreferenced.size() << " of " << archive.textures.size() << " textures (" << prunedlength << " bytes)" << std::endl;
+
+	// New index of every texture that's kept
+	std::vector<uint32_t> texturemap(archive.textures.size(), 0);
+	std::vector<size_t> texturenumbers;
+	for (size_t texturenumber = 0, unreferencednumber = 0; texturenumber < archive.textures.size(); texturenumber++) {
+		if (unreferencednumber < unreferenced.size() && unreferenced[unreferencednumber] == texturenumber) {
+			unreferencednumber++;
+			continue;
+		}
+		texturemap[texturenumber] = texturenumbers.size();
+		texturenumbers.push_back(texturenumber);
+	}
+
+	// The gma is copied as it is, apart from the material texture indices
+	std::vector<uint8_t> gma = archive.gma;
+	for (const GmaModel& model : archive.models) {
+		for (uint32_t materialnumber = 0; materialnumber < model.materialamount; materialnumber++) {
+			uint32_t position = model.start + 0x44 + 0x20 * materialnumber;
+			uint16_t textureindex = bufferShortPluck(gma, position);
+			if (textureindex < texturemap.size()) {
+				gma[position] = texturemap[textureindex] >> 8;
+				gma[position + 1] = texturemap[textureindex] & 0xFF;
+			}
+		}
+	}
+	newgma.write(reinterpret_cast<const char*>(gma.data()), gma.size());
+
+	tplWriteToStream(archive, texturenumbers, 1, newtpl);
+}
+
+int texturePrune(std::string filename) {
+
+	IoQueue queue;
+	ioQueueOpen(queue);
+	ArchiveRead read = archiveRead(queue, filename);
+	Archive archive;
+	if (archiveReadFinish(queue, read, archive) == false) {
+		ioQueueClose(queue);
+		return -1;
+	}
+
+	std::ostringstream newgma;
+	std::ostringstream newtpl;
+	pruneWriteToStreams(archive, newgma, newtpl);
+
+	std::string gmadata = newgma.str();
+	std::string tpldata = newtpl.str();
+	ioWrite(queue, filename + "_pruned.gma", std::vector<uint8_t>(gmadata.begin(), gmadata.end()));
+	ioWrite(queue, filename + "_pruned.tpl", std::vector<uint8_t>(tpldata.begin(), tpldata.end()));
+	ioFlush(queue);
+	bool saved = ioWaitAll(queue);
+	ioQueueClose(queue);
+
+	if (saved == false) {
+		std::cout << "Couldn't save " << filename << "_pruned!" << std::endl;
+		return -1;
+	}
+	std::cout << "Saved to " << filename << "_pruned" << std::endl;
+	return 0;
+}
+
+/*
+
+	Part 16:
+	Repacking
+
+	Rewrites a gma / tpl pair in load order, so a streaming loader can read what it needs first in fewer, longer reads.
+	The load order file lists model names the same way as a -sh group list: models on one line are placed together,
+	lines are placed in order and models that aren't listed follow in their original order.
+	Textures are placed in the order the models first use them, then any unused ones.
+	Every model and texture starts on a multiple of the alignment, and the headers are padded to it.
+
+*/
+
+// Textures in the order the models first use them, followed by the unused ones in their original order
+std::vector<size_t> textureLoadOrder(const Archive& archive, const std::vector<size_t>& modelnumbers) {
+	std::vector<uint8_t> placed(archive.textures.size(), 0);
+	std::vector<size_t> texturenumbers;
+	for (size_t modelnumber : modelnumbers) {
+		for (uint16_t textureindex : modelTextures(archive, archive.models[modelnumber])) {
+			if (placed[textureindex] == 0) {
+				placed[textureindex] = 1;
+				texturenumbers.push_back(textureindex);
+			}
+		}
+	}
+	for (size_t texturenumber = 0; texturenumber < placed.size(); texturenumber++) {
+		if (placed[texturenumber] == 0) {
+			texturenumbers.push_back(texturenumber);
+		}
+	}
+	return texturenumbers;
+}
+
+int archiveRepack(std::string filename, std::string orderpath, std::string alignmenttext) {
+
+	// Decimal or 0x hex
+	char* alignmentend = nullptr;
+	unsigned long alignment = strtoul(alignmenttext.c_str(), &alignmentend, 0);
+	if (*alignmentend != '\0' || alignment < 0x20 || alignment > 0x80000000 || (alignment & (alignment - 1)) != 0) {
+		std::cout << "The alignment has to be a power of two of at least 0x20!" << std::endl;
+		return -1;
+	}
+
+	Archive archive;
+	if (loadArchive(filename, archive) == false) {
+		return -1;
+	}
+
+	std::vector<std::vector<size_t>> groups;
+	if (shardGroups(archive, orderpath, groups) == false) {
+		return -1;
+	}
+	std::vector<size_t> modelnumbers;
+	for (std::vector<size_t>& group : groups) {
+		modelnumbers.insert(modelnumbers.end(), group.begin(), group.end());
+	}
+	std::vector<size_t> texturenumbers = textureLoadOrder(archive, modelnumbers);
+
+	// Offsets are 32 bit, so the padded layout has to fit in 4 GB
+	uint64_t gmalength = 0x8 + 0x8 * uint64_t(modelnumbers.size()) + archive.gma.size() + alignment;
+	for (size_t modelnumber : modelnumbers) {
+		gmalength += (archive.models[modelnumber].end - archive.models[modelnumber].start) + alignment;
+	}
+	uint64_t tpllength = 0x4 + 0x10 * uint64_t(texturenumbers.size()) + alignment;
+	for (size_t texturenumber : texturenumbers) {
+		tpllength += archive.textures[texturenumber].length + alignment;
+	}
+	if (gmalength > 0xffffffff || tpllength > 0xffffffff) {
+		std::cout << "The alignment " << hexString(alignment) << " is too large, the offsets wouldn't fit in 32 bits!" << std::endl;
+		return -1;
+	}
+
+	std::ofstream newgma(filename + "_repacked.gma", std::ios::binary | std::ios::trunc);
+	std::ofstream newtpl(filename + "_repacked.tpl", std::ios::binary | std::ios::trunc);
+	layoutWriteToStreams(archive, modelnumbers, texturenumbers, alignment, newgma, newtpl);
+	newgma.close();
+	newtpl.close();
+	if (newgma.good() == false || newtpl.good() == false) {
+		std::cout << "Couldn't save " << filename << "_repacked!" << std::endl;
+		return -1;
+	}
+
+	std::cout << modelnumbers.size() << " models and " << texturenumbers.size() << " textures repacked with " << hexString(alignment)
+		<< " alignment to " << filename << "_repacked" << std::endl;
+	return 0;
+}
+
+/*
+
+	Part 17:
+	Rule Extraction
+
+	Sorts every model into output files by name rules, all in one run. Each line of a rule file is
+
+		<prefix|suffix|substring|regex> <pattern> <output>
+
+	and blank lines and lines starting with # are skipped. A model goes to the output of the first rule it matches,
+	an output of * is the model's own name. Models with the same output are saved together to <name>_<output>,
+	keeping only the textures they use.
+	The prefix, suffix and substring patterns are compiled into one Aho-Corasick automaton, so each name is scanned once
+	however many rules there are. Regexes are only tried when no earlier rule has matched already.
+
+*/
+
+#define RULE_PREFIX 0
+#define RULE_SUFFIX 1
+#define RULE_SUBSTRING 2
+#define RULE_REGEX 3
+
+struct NameRule {
+	int kind;
+	std::string pattern;
+	std::string output;
+	std::regex expression;
+};
+
+// Rules and the automaton over their plain patterns
+// Each state has a transition for every byte, and lists the rules whose pattern ends there (following fail links)
+struct NameMatcher {
+	std::vector<NameRule> rules;
+	std::vector<std::array<uint32_t, 256>> transitions;
+	std::vector<std::vector<uint32_t>> matches;
+	std::vector<uint32_t> regexrules;
+};
+
+bool ruleFileLoad(std::string rulespath, NameMatcher& matcher) {
+	std::ifstream rulesfile(rulespath);
+	if (rulesfile.good() == false) {
+		std::cout << "Rule file not found! (" << rulespath << ")" << std::endl;
+		return false;
+	}
+
+	std::string line;
+	for (size_t linenumber = 1; std::getline(rulesfile, line); linenumber++) {
+		std::istringstream fields(line);
+		std::string kind;
+		NameRule rule;
+		if (!(fields >> kind) || kind[0] == '#') {
+			continue;
+		}
+		std::string extra;
+		if (!(fields >> rule.pattern >> rule.output) || (fields >> extra)) {
+			std::cout << rulespath << " line " << linenumber << ": expected <prefix|suffix|substring|regex> <pattern> <output>" << std::endl;
+			return false;
+		}
+
+		if (kind == "prefix") {
+			rule.kind = RULE_PREFIX;
+		} else if (kind == "suffix") {
+			rule.kind = RULE_SUFFIX;
+		} else if (kind == "substring") {
+			rule.kind = RULE_SUBSTRING;
+		} else if (kind == "regex") {
+			rule.kind = RULE_REGEX;
+			try {
+				rule.expression = std::regex(rule.pattern, std::regex::ECMAScript | std::regex::optimize);
+			} catch (const std::regex_error& error) {
+				std::cout << rulespath << " line " << linenumber << ": bad regex " << rule.pattern << " (" << error.what() << ")" << std::endl;
+				return false;
+			}
+		} else {
+			std::cout << rulespath << " line " << linenumber << ": unknown rule type " << kind << std::endl;
+			return false;
+		}
+		matcher.rules.push_back(rule);
+	}
+	return true;
+}
+
+// Build the automaton: a trie of the plain patterns, then breadth first fail links folded into the transitions
+void ruleMatcherCompile(NameMatcher& matcher) {
+	matcher.transitions.assign(1, std::array<uint32_t, 256>());
+	matcher.transitions[0].fill(0);
+	matcher.matches.assign(1, std::vector<uint32_t>());
+
+	for (uint32_t rulenumber = 0; rulenumber < matcher.rules.size(); rulenumber++) {
+		const NameRule& rule = matcher.rules[rulenumber];
+		if (rule.kind == RULE_REGEX) {
+			matcher.regexrules.push_back(rulenumber);
+			continue;
+		}
+		uint32_t state = 0;
+		for (unsigned char character : rule.pattern) {
+			if (matcher.transitions[state][character] == 0) {
+				matcher.transitions[state][character] = matcher.transitions.size();
+				matcher.transitions.emplace_back();
+				matcher.transitions.back().fill(0);
+				matcher.matches.emplace_back();
+			}
+			state = matcher.transitions[state][character];
+		}
+		matcher.matches[state].push_back(rulenumber);
+	}
+
+	std::vector<uint32_t> fail(matcher.transitions.size(), 0);
+	std::vector<uint32_t> queue;
+	for (uint32_t next : matcher.transitions[0]) {
+		if (next != 0) {
+			queue.push_back(next);
+		}
+	}
+	for (size_t queueposition = 0; queueposition < queue.size(); queueposition++) {
+		uint32_t state = queue[queueposition];
+		const std::vector<uint32_t>& inherited = matcher.matches[fail[state]];
+		matcher.matches[state].insert(matcher.matches[state].end(), inherited.begin(), inherited.end());
+		for (int character = 0; character < 256; character++) {
+			uint32_t& next = matcher.transitions[state][character];
+			if (next != 0) {
+				fail[next] = matcher.transitions[fail[state]][character];
+				queue.push_back(next);
+			} else {
+				next = matcher.transitions[fail[state]][character];
+			}
+		}
+	}
+}
+
+// Index of the first rule a name matches, or -1
+int ruleMatch(const NameMatcher& matcher, const std::string& name) {
+	uint32_t best = matcher.rules.size();
+	uint32_t state = 0;
+	for (size_t position = 0; position < name.size(); position++) {
+		state = matcher.transitions[state][static_cast<unsigned char>(name[position])];
+		for (uint32_t rulenumber : matcher.matches[state]) {
+			const NameRule& rule = matcher.rules[rulenumber];
+			if (rulenumber >= best
+				|| (rule.kind == RULE_PREFIX && position + 1 != rule.pattern.size())
+				|| (rule.kind == RULE_SUFFIX && position + 1 != name.size())) {
+				continue;
+			}
+			best = rulenumber;
+		}
+	}
+
+	for (uint32_t rulenumber : matcher.regexrules) {
+		if (rulenumber >= best) {
+			break;
+		}
+		if (std::regex_search(name, matcher.rules[rulenumber].expression)) {
+			best = rulenumber;
+		}
+	}
+	return best == matcher.rules.size() ? -1 : int(best);
+}
+
+int ruleExtract(std::string filename, std::string rulespath) {
+
+	NameMatcher matcher;
+	if (ruleFileLoad(rulespath, matcher) == false) {
+		return -1;
+	}
+	ruleMatcherCompile(matcher);
+
+	Archive archive;
+	if (loadArchive(filename, archive) == false) {
+		return -1;
+	}
+
+	// Sort the models into outputs, in the order the outputs are first used
+	std::vector<std::string> outputs;
+	std::vector<std::vector<size_t>> outputmodels;
+	std::map<std::string, size_t> outputnumbers;
+	size_t unmatchedamount = 0;
+	for (size_t modelnumber = 0; modelnumber < archive.models.size(); modelnumber++) {
+		const GmaModel& model = archive.models[modelnumber];
+		int rulenumber = ruleMatch(matcher, model.name);
+		if (rulenumber < 0) {
+			unmatchedamount++;
+			continue;
+		}
+		std::string output = matcher.rules[rulenumber].output == "*" ? model.name : matcher.rules[rulenumber].output;
+		std::map<std::string, size_t>::iterator found = outputnumbers.find(output);
+		if (found == outputnumbers.end()) {
+			found = outputnumbers.insert(std::make_pair(output, outputs.size())).first;
+			outputs.push_back(output);
+			outputmodels.emplace_back();
+		}
+		outputmodels[found->second].push_back(modelnumber);
+	}
+
+	if (outputs.empty()) {
+		std::cout << "No model matched the rules!" << std::endl;
+		return 1;
+	}
+
+	// Each output is written on its own thread
+	std::vector<uint8_t> saved(outputs.size(), 0);
+	parallelFor(outputs.size(), [&](size_t outputnumber) {
+		std::string outname = filename + "_" + outputs[outputnumber];
+		std::ofstream newgma(outname + ".gma", std::ios::binary | std::ios::trunc);
+		std::ofstream newtpl(outname + ".tpl", std::ios::binary | std::ios::trunc);
+		subsetWriteToStreams(archive, outputmodels[outputnumber], newgma, newtpl);
+		newgma.close();
+		newtpl.close();
+		saved[outputnumber] = newgma.good() && newtpl.good();
+	});
+
+	int result = 0;
+	for (size_t outputnumber = 0; outputnumber < outputs.size(); outputnumber++) {
+		if (saved[outputnumber] == false) {
+			std::cout << "Couldn't save " << filename << "_" << outputs[outputnumber] << "!" << std::endl;
+			result = 1;
+			continue;
+		}
+		for (size_t modelnumber : outputmodels[outputnumber]) {
+			std::cout << archive.models[modelnumber].name << " ";
+		}
+		std::cout << "saved to " << filename << "_" << outputs[outputnumber] << std::endl;
+	}
+	std::cout << archive.models.size() - unmatchedamount << " of " << archive.models.size() << " models matched" << std::endl;
+	return result;
+}
+
+/*
+
+	Utility Functions
+
+*/
+
+constexpr bool isLittleEndian() {
+	//shamelessly pinched from StackOverflow
+	short int number = 1;
+	char *numPtr = (char*)&number;
+	return (numPtr[0] == 1);
+	
+}
+
+uint32_t fileIntPluck (std::istream& bif, uint32_t offset) {
+	bif.seekg(offset, bif.beg);
+	char buffer[4]; //4 byte buffer
+	bif.read(buffer, 0x4);
+	//convert signed to unsigned
+	unsigned char* ubuf = reinterpret_cast<unsigned char*>(buffer);
+	uint32_t returnint = 0;
+	if (isLittleEndian()) {
+		returnint = (ubuf[3] << 0) | (ubuf[2] << 8) | (ubuf[1] << 16) | (ubuf[0] << 24);
+	} else {
+		returnint = (ubuf[0] << 0) | (ubuf[1] << 8) | (ubuf[2] << 16) | (ubuf[3] << 24);
+	}
+	return returnint;
+}
+
+uint16_t fileShortPluck (std::istream& bif, uint32_t offset) {
+	bif.seekg(offset, bif.beg);
+	char buffer[2]; //2 byte buffer
+	bif.read(buffer, 0x2);
+	//convert signed to unsigned
+	unsigned char* ubuf = reinterpret_cast<unsigned char*>(buffer);
+	uint16_t returnshort = 0;
+	if (isLittleEndian()) {
+		returnshort = (ubuf[1] << 0) | (ubuf[0] << 8);
+	} else {
+		returnshort = (ubuf[0] << 0) | (ubuf[1] << 8);
+	}
+	return returnshort;
+}
+
+void helpText() {
+	std::cout << "How to use gmatool:\n" 
+		<< "Each of these saves extracted data to unique and readable gma and tpl files, and do not alter the input files.\n"
+		<< "\"-ge <name>\" - Extracts goal data from <name>.gma and <name>.tpl.\n"
+		<< "\"-se <name>\" - Extracts switch data from <name>.gma and <name>.tpl, saving each switch to unique files, including switch bases.\n"
+		<< "\"-me <name> <modelname>\" - Extracts the data of the model called \"modelname\" from <name>.gma and <name>.tpl.\n"
+		<< "\"-ae <name>\" - Extracts every model in <name>.gma and <name>.tpl to its own <name>_<modelname> gma and tpl.\n"
+		<< "\"-re <name> <rules>\" - Sorts the models of <name>.gma and <name>.tpl into <name>_<output> files in one run, using the first line of the <rules> file "
+		<< "each model name matches (<prefix|suffix|substring|regex> <pattern> <output>, * as the output uses the model name).\n"
+		<< "\"-aes <store> <name> [<name>...]\" - Same as \"-ae\" for each <name>, but textures are written once to the <store> directory, "
+		<< "named by content hash, and each model gets a <name>_<modelname>.tpr listing its textures instead of a tpl.\n"
+		<< "\"-tb <store> <name>\" - Rebuilds <name>.tpl from <name>.tpr and the textures in <store>.\n"
+		<< "\"-l <name>\" - Lists all models in <name>.gma.\n"
+		<< "\"-le <name>\" - Combines the functionality of \"-l\" and \"-me\".\n"
+		<< "\"-m <name1> <name2> [prune]\" - Extracts all data from <name1>.gma, <name2>.gma, <name1>.tpl and <name2>.tpl, and combines the data. "
+		<< "The second file's data is always placed after the first. With \"prune\", textures no material uses are left out.\n"
+		<< "\"-rp <name> <loadorder> [alignment]\" - Saves <name>.gma and <name>.tpl to <name>_repacked with the models in the order of the <loadorder> file "
+		<< "(model names, one group per line, unlisted models last) and the textures in the order they're first used. "
+		<< "Every model and texture starts on a multiple of [alignment] (0x20 by default).\n"
+		<< "\"-p <name>\" - Saves <name>.gma and <name>.tpl to <name>_pruned without the textures no material uses, renumbering the materials' textures.\n"
+		<< "\"-w <name1> <name2> [slack]\" - Same as \"-m\", then rebuilds the output whenever an input file is written, "
+		<< "rewriting only what changed. [slack] extra bytes are reserved after <name1>'s data so it can grow without a full rebuild.\n"
+		<< "\"-sh <name> <count|grouplist> [dup]\" - Splits <name>.gma and <name>.tpl into <name>_shard<number> pairs, each with only the textures it uses. "
+		<< "Either <count> shards of similar size, or one shard per line of model names in the <grouplist> file. "
+		<< "Models sharing textures are kept together unless \"dup\" is given, which copies shared textures into every shard using them.\n"
+		<< "\"-ve <name>\" - Exports the triangles of every model in <name>.gma as flat little endian buffers: <name>_<modelname>.pos, .nrm and .uv "
+		<< "(floats) and .idx (uint32 triangle list).\n"
+		<< "\"-td <name> [png|ppm|raw]\" - Decodes every texture in <name>.tpl to <name>_texture<number> images (png by default).\n"
+		<< "\"-i <name> [json|bin]\" - Prints the offsets, sizes, materials and texture references of every model in <name>.gma, "
+		<< "and the format, size and dimensions of every texture in <name>.tpl, to stdout as JSON (or binary).\n"
+		<< "\"--manifest <name> [json|bin]\" - Writes the offset, size and content hash of every model, material block and texture "
+		<< "in <name>.gma and <name>.tpl to <name>_manifest.json (or .bin).\n"
+		<< "\"-d <name1> <name2>\" - Lists the models added, removed or changed between <name1> and <name2>, "
+		<< "and which sections of each changed model differ.\n"
+		<< "\"-v <name> [<name>...]\" - Checks every header entry, name, material texture index and texture range of each gma / tpl pair "
+		<< "against the file bounds, without writing anything.\n"
+		<< "Stream modes read and write a single gma + tpl stream instead of file pairs. Any <stream> can be \"-\" for stdin / stdout.\n"
+		<< "\"-sp <name> <stream>\" - Packs <name>.gma and <name>.tpl into <stream>.\n"
+		<< "\"-su <stream> <name>\" - Unpacks <stream> to <name>.gma and <name>.tpl.\n"
+		<< "\"-sme <stream> <modelname> <outstream>\" - Same as \"-me\", from <stream> to <outstream>.\n"
+		<< "\"-sm <stream1> <stream2> <outstream>\" - Same as \"-m\", from <stream1> and <stream2> to <outstream>." << std::endl;
+}
+
+void copyBytes(std::istream& bif, std::ostream& bof, uint32_t offset, uint32_t length) {
+	// Copy in chunks, large models would overflow a thread's stack
+	char bytes[0x10000];
+	bif.seekg(offset, bif.beg);
+	while (length > 0) {
+		uint32_t chunklength = std::min<uint32_t>(length, sizeof(bytes));
+		bif.read(bytes, chunklength);
+		bof.write(bytes, chunklength);
+		length -= chunklength;
+	}
+}
+
+void saveIntToFileEnd(std::ostream& bof, uint32_t newint) {
+	char buffer[4];
+	char* initbuffer = reinterpret_cast<char*>(&newint);
+		//assigns values wrt endianness
+		if (isLittleEndian()) {
+			for (int i = 0; i < 4; i++) {
+				buffer[i] = initbuffer[3-i];
+			}
+		} else {
+			for (int i = 0; i < 4; i++) {
+				buffer[i] = initbuffer[i];
+			}
+		}
+		//write float
+		bof.write(buffer, sizeof(uint32_t));
+}
+
+void saveShortToFileEnd(std::ostream& bof, uint16_t newint) {
+	char buffer[2];
+	char* initbuffer = reinterpret_cast<char*>(&newint);
+		//assigns values wrt endianness
+		if (isLittleEndian()) {
+			for (int i = 0; i < 2; i++) {
+				buffer[i] = initbuffer[1-i];
+			}
+		} else {
+			for (int i = 0; i < 2; i++) {
+				buffer[i] = initbuffer[i];
+			}
+		}
+		//write float
+		bof.write(buffer, sizeof(uint16_t));
+}
+
+uint32_t getFileLength(std::istream& bif) {
+	bif.seekg(0, bif.end);
+	return bif.tellg();
+}
+
+// Length of a model name from a gma header, Includes the terminating byte.
+uint32_t getModelNameLength(std::istream& bif, uint32_t modelnameoffset) {
+
+	// Get to start of model name
+	bif.seekg(modelnameoffset, bif.beg);
+
+	size_t modelnamelength = 0;
+	bool endofmodelname = false;
+	char endingbyte;
+
+	// Read name byte by byte
+	while (endofmodelname == false) {
+		modelnamelength++;
+		bif.read(&endingbyte, 1);
+		if (bif.eof() || endingbyte == '\0') {
+			endofmodelname = true;
+		}
+	}
+	
+	return modelnamelength;
+}
+
+void padZeroes(std::ostream& bof, uint32_t zeronumber) {
+	// Write in chunks, large alignments would overflow the stack
+	static const char zeroes[0x10000] = {0};
+	while (zeronumber > 0) {
+		uint32_t chunklength = std::min<uint32_t>(zeronumber, sizeof(zeroes));
+		bof.write(zeroes, chunklength);
+		zeronumber -= chunklength;
+	}
+}
+
+std::string readNameFromGma(std::istream& gma, uint32_t modellistpointer, uint32_t modelnamelength) {
+	char bytes[modelnamelength];
+	gma.seekg(modellistpointer, gma.beg);
+	gma.read(bytes, modelnamelength);
+	std::string modelname(bytes);
+	return modelname;
+}
+
+bool loadFile(std::string path, std::vector<uint8_t>& data) {
+	std::ifstream bif(path, std::ios::binary);
+	if (bif.good() == false) {
+		return false;
+	}
+	data.resize(getFileLength(bif));
+	bif.seekg(0, bif.beg);
+	bif.read(reinterpret_cast<char*>(data.data()), data.size());
+	return bif.good() || data.empty();
+}
+
+// Big endian reads from a file already loaded into memory
+uint32_t bufferIntPluck(const std::vector<uint8_t>& buffer, uint32_t offset) {
+	return (buffer[offset] << 24) | (buffer[offset + 1] << 16) | (buffer[offset + 2] << 8) | buffer[offset + 3];
+}
+
+uint16_t bufferShortPluck(const std::vector<uint8_t>& buffer, uint32_t offset) {
+	return (buffer[offset] << 8) | buffer[offset + 1];
+}
+
+// Runs work for every index below count, spread over one thread per core
+void parallelFor(size_t count, const std::function<void(size_t)>& work) {
+	size_t threadamount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), count);
+	std::atomic<size_t> nextindex(0);
+
+	auto worker = [&]() {
+		for (size_t index = nextindex++; index < count; index = nextindex++) {
+			work(index);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t threadnumber = 1; threadnumber < threadamount; threadnumber++) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+// XXH64 (seed 0), a fast non cryptographic hash
+uint64_t hash64(const uint8_t* data, size_t length) {
+	const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+	const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+	const uint64_t prime3 = 0x165667B19E3779F9ULL;
+	const uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+	const uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+	auto rotl = [](uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); };
+	auto read64 = [](const uint8_t* p) { uint64_t value; memcpy(&value, p, 8); return isLittleEndian() ? value : __builtin_bswap64(value); };
+	auto read32 = [](const uint8_t* p) { uint32_t value; memcpy(&value, p, 4); return isLittleEndian() ? value : __builtin_bswap32(value); };
+	auto round = [&](uint64_t accumulator, uint64_t input) { return rotl(accumulator + input * prime2, 31) * prime1; };
+	auto merge = [&](uint64_t accumulator, uint64_t value) { return (accumulator ^ round(0, value)) * prime1 + prime4; };
+
+	const uint8_t* p = data;
+	const uint8_t* end = data + length;
+	uint64_t hash;
+
+	if (length >= 32) {
+		uint64_t v1 = prime1 + prime2;
+		uint64_t v2 = prime2;
+		uint64_t v3 = 0;
+		uint64_t v4 = -prime1;
+		for (; p + 32 <= end; p += 32) {
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+		}
+		hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		hash = merge(hash, v1);
+		hash = merge(hash, v2);
+		hash = merge(hash, v3);
+		hash = merge(hash, v4);
+	} else {
+		hash = prime5;
+	}
+	hash += length;
+
+	for (; p + 8 <= end; p += 8) {
+		hash = rotl(hash ^ round(0, read64(p)), 27) * prime1 + prime4;
+	}
+	if (p + 4 <= end) {
+		hash = rotl(hash ^ (read32(p) * prime1), 23) * prime2 + prime3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		hash = rotl(hash ^ (*p * prime5), 11) * prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+std::string jsonString(std::string text) {
+	std::string quoted = "\"";
+	for (char character : text) {
+		if (character == '"' || character == '\\') {
+			quoted += '\\';
+			quoted += character;
+		} else if (static_cast<unsigned char>(character) < 0x20) {
+			char escaped[7];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", character);
+			quoted += escaped;
+		} else {
+			quoted += character;
+		}
+	}
+	return quoted + "\"";
 }
 
 /*
@@ -949,12 +4670,12 @@ std::string readNameFromGma(std::ifstream& gma, uint32_t modellistpointer, uint3
 */
 
 // Convert from position in model list to position in header
-size_t modelNumberWithEmpties(std::ifstream& oldgma, size_t modelnumber) {
+size_t modelNumberWithEmpties(std::istream& oldgma, size_t modelnumber) {
 	size_t currententry = 0;
 	size_t entrywithempties = 0;
 	// Keep separate counts for empty and nonempty entries, stopping when we find our original nonempty model
 	while (currententry <= modelnumber) {
-		uint32_t emptyIndicator = fileIntPluck(oldgma, 0x8 * entrywithempties);
+		uint32_t emptyIndicator = fileIntPluck(oldgma, 0x08 + 0x8 * entrywithempties);
 		if (emptyIndicator != 0xffffffff) {
 			currententry++;
 		}
@@ -964,7 +4685,7 @@ size_t modelNumberWithEmpties(std::ifstream& oldgma, size_t modelnumber) {
 }
 
 // Index of the last model header entry that isn't an empty entry
-size_t indexOfFinalNonEmptyEntry(std::ifstream& oldgma, size_t modelamount) {
+size_t indexOfFinalNonEmptyEntry(std::istream& oldgma, size_t modelamount) {
 	size_t result = 0;
 	for (size_t currententry = 0; currententry < modelamount; currententry++) {
 		uint32_t emptyIndicator = fileIntPluck(oldgma, 0x08 + 0x8 * currententry);
@@ -977,7 +4698,7 @@ size_t indexOfFinalNonEmptyEntry(std::ifstream& oldgma, size_t modelamount) {
 
 // Counts the number of model header entries for non empty models
 // This should be the same as the length of the model list
-size_t modelAmountWithoutEmpties(std::ifstream& oldgma, size_t modelamount) {
+size_t modelAmountWithoutEmpties(std::istream& oldgma, size_t modelamount) {
 
 	size_t currententry = 0;
 	size_t entrywithempties = 0;
@@ -998,7 +4719,7 @@ size_t modelAmountWithoutEmpties(std::ifstream& oldgma, size_t modelamount) {
 
 // Count the number of texture headers until the next non empty entry
 // (Returns 1 when there are no empty entries)
-size_t nextNonEmptyTextureOffset(std::ifstream& oldtpl, uint32_t headerposition) {
+size_t nextNonEmptyTextureOffset(std::istream& oldtpl, uint32_t headerposition) {
 	size_t positionoffset = 1;
 
 	// This will be 0 if the next texture is empty